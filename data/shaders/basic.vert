@@ -3,9 +3,11 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec4 aColor;
 layout (location = 2) in vec2 aUV;
+layout (location = 3) in float aMaterial;
 //layout (location = 2) in vec3 aNormal;
 
 uniform mat4 uCamera;
+uniform sampler2D uMaterialRects; // x, y, width, height of every material in the sheet, 256 per row
 
 out vec4 vCol;
 out vec2 vUV;
@@ -16,5 +18,9 @@ void main()
     //vec3 cPos = vec3(uCamera[0][3], uCamera[1][3], uCamera[2][3]);
     //cPos = cPos - gl_Position.xyz;
     vCol = aColor;
-    vUV = aUV;
+
+    // UVs are relative to the polygon's texture, its rectangle in the sheet comes from the table
+    int slot = int(aMaterial);
+    vec4 rect = slot < 0 ? vec4(0.0, 0.0, 1.0, 1.0) : texelFetch(uMaterialRects, ivec2(slot % 256, slot / 256), 0);
+    vUV = rect.xy + aUV * rect.zw;
 }
\ No newline at end of file
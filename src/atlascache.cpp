@@ -0,0 +1,239 @@
+#include "atlascache.h"
+#include "filereader.h"
+#include "dfxrecords.h"
+#include <bit>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <thread>
+
+namespace
+{
+	// Bumped whenever the file layout or the way textures are decoded changes
+	constexpr u32 c_CACHEVERSION = 4;
+	constexpr char c_CACHEMAGIC[4] = { 'G', 'X', 'A', 'C' };
+	const char* c_CACHEDIRECTORY = "cache";
+
+	struct cacheheader_t
+	{
+		char magic[4];
+		u32 version;
+		uint64_t key;
+		u32 w, h;
+		u32 nImages;
+		u32 nTextures;
+	};
+
+	struct cacheimage_t
+	{
+		i32 id;
+		i32 x, y;
+		i32 width, height;
+	};
+
+	struct cachetexture_t
+	{
+		u32 w, h;
+		i32 x, y;
+		i32 sharesWith;
+		byte argb1555;
+		byte decoded;
+		byte alpha;
+	};
+
+	// The texels start on a 16 byte boundary after the tables
+	size_t GetTexelOffset(const cacheheader_t& header)
+	{
+		const size_t end = sizeof(cacheheader_t) + header.nImages * sizeof(cacheimage_t) + header.nTextures * sizeof(cachetexture_t);
+		return (end + 15) & ~(size_t)15;
+	}
+
+	std::string GetCachePath(uint64_t key)
+	{
+		char name[32];
+		snprintf(name, sizeof(name), "%016llx.atlas", (unsigned long long)key);
+		return std::string(c_CACHEDIRECTORY) + "/" + name;
+	}
+
+	constexpr uint64_t c_PRIME0 = 0x9E3779B97F4A7C15ull;
+	constexpr uint64_t c_PRIME1 = 0xC2B2AE3D27D4EB4Full;
+
+	uint64_t Mix(uint64_t h)
+	{
+		h ^= h >> 33;
+		h *= 0xFF51AFD7ED558CCDull;
+		h ^= h >> 33;
+		h *= 0xC4CEB9FE1A85EC53ull;
+		h ^= h >> 33;
+		return h;
+	}
+}
+
+uint64_t HashBytes(const void* data, size_t size, uint64_t seed)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+
+	// Four independent lanes over 32 byte stripes, so the multiplies don't wait on each other
+	uint64_t lanes[4] = { seed + c_PRIME0, seed + c_PRIME1, seed ^ c_PRIME0, seed ^ c_PRIME1 };
+	size_t i = 0;
+	for (; i + 32 <= size; i += 32)
+	{
+		for (int l = 0; l < 4; ++l)
+		{
+			uint64_t v;
+			memcpy(&v, bytes + i + l * 8, 8);
+			lanes[l] = std::rotl(lanes[l] + v * c_PRIME1, 31) * c_PRIME0;
+		}
+	}
+
+	uint64_t h = seed ^ (size * c_PRIME0);
+	for (int l = 0; l < 4; ++l)
+		h = std::rotl(h ^ Mix(lanes[l]), 27) * c_PRIME0;
+
+	for (; i + 8 <= size; i += 8)
+	{
+		uint64_t v;
+		memcpy(&v, bytes + i, 8);
+		h = std::rotl(h ^ (v * c_PRIME1), 27) * c_PRIME0;
+	}
+	for (; i < size; ++i)
+		h = std::rotl(h ^ (bytes[i] * c_PRIME1), 11) * c_PRIME0;
+
+	return Mix(h);
+}
+
+uint64_t GetAtlasCacheKey(const file_t& vfx, const std::vector<texture_t>& customImages, int padding, ImagePacker::EStrategy strategy)
+{
+	uint64_t key = HashBytes(vfx.data, vfx.size, c_CACHEVERSION);
+	const int layout[3] = { ImagePacker::Version, padding, (int)strategy };
+	key = HashBytes(layout, sizeof(layout), key);
+	for (auto& image : customImages)
+	{
+		const u32 size[2] = { image.w, image.h };
+		key = HashBytes(size, sizeof(size), key);
+		key = HashBytes(image.pixels, image.w * image.h * sizeof(rgba8_t), key);
+	}
+	return key;
+}
+
+bool LoadCachedAtlas(uint64_t key, level_t& level, size_t textureCount)
+{
+	file_t file;
+	if (!ReadFile(GetCachePath(key), file, EFileAccess::Sequential))
+		return false;
+
+	const cursor_t head = file.At(0, sizeof(cacheheader_t));
+	if (!head)
+		return false;
+
+	cacheheader_t header;
+	memcpy(&header, head.ptr(), sizeof(header));
+	if (memcmp(header.magic, c_CACHEMAGIC, 4) != 0 || header.version != c_CACHEVERSION || header.key != key || header.nTextures != textureCount)
+		return false;
+
+	const cursor_t images = file.At(sizeof(cacheheader_t), header.nImages * sizeof(cacheimage_t));
+	const cursor_t textures = images ? file.At(sizeof(cacheheader_t) + images.size, header.nTextures * sizeof(cachetexture_t)) : cursor_t{};
+	const cursor_t texels = file.At(GetTexelOffset(header), (size_t)header.w * header.h * sizeof(rgba8_t));
+	if (!images || !textures || !texels)
+		return false;
+
+	ImagePacker::ImageInformationList list;
+	list.reserve(header.nImages);
+	for (u32 i = 0; i < header.nImages; ++i)
+	{
+		cacheimage_t image;
+		memcpy(&image, images.ptr(i * sizeof(cacheimage_t)), sizeof(image));
+		ImagePacker::ImageInformation_t info(image.width, image.height, (void*)(intptr_t)image.id);
+		info.x = image.x;
+		info.y = image.y;
+		list.push_back(info);
+	}
+
+	std::vector<texture_t> textureList;
+	textureList.reserve(header.nTextures);
+	for (u32 i = 0; i < header.nTextures; ++i)
+	{
+		cachetexture_t cached;
+		memcpy(&cached, textures.ptr(i * sizeof(cachetexture_t)), sizeof(cached));
+		if (cached.sharesWith >= (i32)i)
+			return false;
+
+		texture_t texture{ cached.w, cached.h, NULL, false, cached.argb1555 != 0 };
+		texture.x = cached.x;
+		texture.y = cached.y;
+		texture.sharesWith = cached.sharesWith;
+		texture.decoded = cached.decoded != 0;
+		texture.alpha = (ETextureAlpha)cached.alpha;
+		textureList.push_back(texture);
+	}
+
+	level.list = std::move(list);
+	level.textures = std::move(textureList);
+
+	// The sheet keeps changing after the load (cutouts, gutters), so it gets its own copy of the texels
+	level.sheet = { header.w, header.h, new rgba8_t[(size_t)header.w * header.h] };
+	memcpy(level.sheet.pixels, texels.ptr(), texels.size);
+	return true;
+}
+
+bool SaveCachedAtlas(uint64_t key, const level_t& level)
+{
+	std::error_code error;
+	std::filesystem::create_directories(c_CACHEDIRECTORY, error);
+
+	// Written next to the real file first, so a load running at the same time never sees half of it
+	const std::string path = GetCachePath(key);
+	const std::string temporary = path + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+	FILE* f = NULL;
+	fopen_s(&f, temporary.c_str(), "wb");
+	if (!f)
+	{
+		printf("Couldn't write the sheet cache to %s\n", temporary.c_str());
+		return false;
+	}
+
+	cacheheader_t header;
+	memcpy(header.magic, c_CACHEMAGIC, 4);
+	header.version = c_CACHEVERSION;
+	header.key = key;
+	header.w = level.sheet.w;
+	header.h = level.sheet.h;
+	header.nImages = (u32)level.list.size();
+	header.nTextures = (u32)level.textures.size();
+
+	std::vector<unsigned char> tables;
+	tables.reserve(GetTexelOffset(header));
+	auto append = [&tables](const auto& value)
+		{
+			const unsigned char* bytes = (const unsigned char*)&value;
+			tables.insert(tables.end(), bytes, bytes + sizeof(value));
+		};
+
+	append(header);
+	for (auto& info : level.list)
+		append(cacheimage_t{ (i32)(intptr_t)info.userdata, info.x, info.y, info.width, info.height });
+	// Cutouts come from the materials of the level, not the VFX, so textures decoded as cutouts are
+	// written as not decoded and whichever level loads the sheet decodes them again
+	for (auto& texture : level.textures)
+	{
+		const bool decoded = texture.decoded && !texture.cutout;
+		append(cachetexture_t{ texture.w, texture.h, texture.x, texture.y, texture.sharesWith, texture.argb1555, decoded, (byte)(decoded ? texture.alpha : ETextureAlpha::Opaque) });
+	}
+	tables.resize(GetTexelOffset(header), 0);
+
+	const size_t texelBytes = (size_t)level.sheet.w * level.sheet.h * sizeof(rgba8_t);
+	const bool written = fwrite(tables.data(), tables.size(), 1, f) == 1 && fwrite(level.sheet.pixels, texelBytes, 1, f) == 1;
+	fclose(f);
+
+	std::error_code renamed;
+	if (written)
+		std::filesystem::rename(temporary, path, renamed);
+	if (!written || renamed)
+	{
+		std::filesystem::remove(temporary, error);
+		printf("Couldn't write the sheet cache to %s\n", path.c_str());
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include "mapreader.h"
+#include <cstdint>
+
+// Packed and decoded texture sheets are kept on disk, keyed by everything that goes into them, so
+// opening a level again can skip both the packing and the decoding. Files are written in the native
+// byte order and only ever read back on the same machine.
+
+// Fast non-cryptographic 64 bit hash, good enough to tell files apart
+uint64_t HashBytes(const void* data, size_t size, uint64_t seed = 0);
+
+// Key of the sheet built from the VFX and the custom images, packed with the current version of the
+// strategy and the given padding
+uint64_t GetAtlasCacheKey(const file_t& vfx, const std::vector<texture_t>& customImages, int padding, ImagePacker::EStrategy strategy);
+
+// Fills level.list, level.sheet and level.textures from the cached sheet. False if there's nothing
+// cached under key, or if it doesn't hold textureCount textures.
+bool LoadCachedAtlas(uint64_t key, level_t& level, size_t textureCount);
+
+// Writes level.list, level.sheet and level.textures to the cache under key. Cutouts depend on the
+// level's materials, so textures decoded as cutouts are stored as not decoded.
+bool SaveCachedAtlas(uint64_t key, const level_t& level);
@@ -0,0 +1,489 @@
+#include "blockcompress.h"
+#include "dfxrecords.h"
+#include "cpufeatures.h"
+#include "threadpool.h"
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+
+#if defined(CPU_X86)
+#include <immintrin.h>
+#endif
+
+// The kernels load whole texels as 32 bit lanes
+static_assert(sizeof(rgba8_t) == 4);
+
+namespace
+{
+	// A 4x4 block copied out of the image, row by row
+	struct block_t
+	{
+		rgba8_t texels[16];
+	};
+
+	u16 To565(const int c[3])
+	{
+		const int r = (c[0] * 31 + 127) / 255;
+		const int g = (c[1] * 63 + 127) / 255;
+		const int b = (c[2] * 31 + 127) / 255;
+		return (u16)((r << 11) | (g << 5) | b);
+	}
+
+	void From565(u16 color, int c[3])
+	{
+		const int r = (color >> 11) & 0x1F;
+		const int g = (color >> 5) & 0x3F;
+		const int b = color & 0x1F;
+		c[0] = (r << 3) | (r >> 2);
+		c[1] = (g << 2) | (g >> 4);
+		c[2] = (b << 3) | (b >> 2);
+	}
+
+	// Colour bounds of the block. With opaqueOnly, texels that will end up transparent are left out
+	// and lo ends up above hi if that's all of them.
+	void BoundsScalar(const block_t& block, bool opaqueOnly, rgba8_t& lo, rgba8_t& hi)
+	{
+		lo = { 255, 255, 255, 255 };
+		hi = { 0, 0, 0, 0 };
+		for (const rgba8_t& p : block.texels)
+		{
+			if (opaqueOnly && p.a < 128)
+				continue;
+
+			lo = { std::min(lo.r, p.r), std::min(lo.g, p.g), std::min(lo.b, p.b), std::min(lo.a, p.a) };
+			hi = { std::max(hi.r, p.r), std::max(hi.g, p.g), std::max(hi.b, p.b), std::max(hi.a, p.a) };
+		}
+	}
+
+	// How far along dir every texel is from base (a dot product, not normalised)
+	void ProjectScalar(const block_t& block, const int base[3], const int dir[3], int out[16])
+	{
+		for (int i = 0; i < 16; ++i)
+		{
+			const rgba8_t& p = block.texels[i];
+			out[i] = (p.r - base[0]) * dir[0] + (p.g - base[1]) * dir[1] + (p.b - base[2]) * dir[2];
+		}
+	}
+
+#if defined(CPU_X86)
+	TARGET_SSE2 void BoundsSSE2(const block_t& block, bool opaqueOnly, rgba8_t& lo, rgba8_t& hi)
+	{
+		const __m128i ones = _mm_set1_epi32(-1);
+		const __m128i threshold = _mm_set1_epi32(127);
+		__m128i mn = ones;
+		__m128i mx = _mm_setzero_si128();
+		for (int i = 0; i < 16; i += 4)
+		{
+			__m128i px = _mm_loadu_si128((const __m128i*)&block.texels[i]);
+			__m128i pxMin = px, pxMax = px;
+			if (opaqueOnly)
+			{
+				// Transparent texels turn white for the minimum and black for the maximum
+				const __m128i opaque = _mm_cmpgt_epi32(_mm_srli_epi32(px, 24), threshold);
+				pxMin = _mm_or_si128(px, _mm_andnot_si128(opaque, ones));
+				pxMax = _mm_and_si128(px, opaque);
+			}
+			mn = _mm_min_epu8(mn, pxMin);
+			mx = _mm_max_epu8(mx, pxMax);
+		}
+
+		mn = _mm_min_epu8(mn, _mm_shuffle_epi32(mn, _MM_SHUFFLE(1, 0, 3, 2)));
+		mn = _mm_min_epu8(mn, _mm_shuffle_epi32(mn, _MM_SHUFFLE(2, 3, 0, 1)));
+		mx = _mm_max_epu8(mx, _mm_shuffle_epi32(mx, _MM_SHUFFLE(1, 0, 3, 2)));
+		mx = _mm_max_epu8(mx, _mm_shuffle_epi32(mx, _MM_SHUFFLE(2, 3, 0, 1)));
+
+		const int mnBits = _mm_cvtsi128_si32(mn);
+		const int mxBits = _mm_cvtsi128_si32(mx);
+		memcpy(&lo, &mnBits, 4);
+		memcpy(&hi, &mxBits, 4);
+	}
+
+	TARGET_SSE2 void ProjectSSE2(const block_t& block, const int base[3], const int dir[3], int out[16])
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i base16 = _mm_set_epi16(0, (short)base[2], (short)base[1], (short)base[0], 0, (short)base[2], (short)base[1], (short)base[0]);
+		const __m128i dir16 = _mm_set_epi16(0, (short)dir[2], (short)dir[1], (short)dir[0], 0, (short)dir[2], (short)dir[1], (short)dir[0]);
+		for (int i = 0; i < 16; i += 4)
+		{
+			const __m128i px = _mm_loadu_si128((const __m128i*)&block.texels[i]);
+
+			// r * dr + g * dg and b * db + 0 for two texels each
+			const __m128i lo = _mm_madd_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(px, zero), base16), dir16);
+			const __m128i hi = _mm_madd_epi16(_mm_sub_epi16(_mm_unpackhi_epi8(px, zero), base16), dir16);
+
+			const __m128i even = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(2, 0, 2, 0)));
+			const __m128i odd = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(3, 1, 3, 1)));
+			_mm_storeu_si128((__m128i*)&out[i], _mm_add_epi32(even, odd));
+		}
+	}
+#endif
+
+	struct kernels_t
+	{
+		void(*bounds)(const block_t&, bool, rgba8_t&, rgba8_t&);
+		void(*project)(const block_t&, const int[3], const int[3], int[16]);
+	};
+
+	const kernels_t& Kernels()
+	{
+		static const kernels_t kernels = []
+			{
+#if defined(CPU_X86)
+				if (CPU::HasSSE2())
+					return kernels_t{ BoundsSSE2, ProjectSSE2 };
+#endif
+				return kernels_t{ BoundsScalar, ProjectScalar };
+			}();
+		return kernels;
+	}
+
+	void WriteColorBlock(unsigned char* out, u16 c0, u16 c1, u32 indices)
+	{
+		out[0] = (unsigned char)(c0 & 0xFF);
+		out[1] = (unsigned char)(c0 >> 8);
+		out[2] = (unsigned char)(c1 & 0xFF);
+		out[3] = (unsigned char)(c1 >> 8);
+		for (int i = 0; i < 4; ++i)
+			out[4 + i] = (unsigned char)(indices >> (i * 8));
+	}
+
+	// Direction the block's colours spread out the most in (power iteration on their covariance),
+	// scaled to integers up to 255. Falls back to the bounding box diagonal for flat blocks.
+	void PrincipalAxis(const block_t& block, bool opaqueOnly, const rgba8_t& lo, const rgba8_t& hi, int axis[3])
+	{
+		int n = 0;
+		int sum[3] = { 0, 0, 0 };
+		for (const rgba8_t& p : block.texels)
+		{
+			if (opaqueOnly && p.a < 128)
+				continue;
+			sum[0] += p.r;
+			sum[1] += p.g;
+			sum[2] += p.b;
+			++n;
+		}
+
+		const float mean[3] = { sum[0] / (float)n, sum[1] / (float)n, sum[2] / (float)n };
+		float cov[6] = { 0, 0, 0, 0, 0, 0 }; // rr, rg, rb, gg, gb, bb
+		for (const rgba8_t& p : block.texels)
+		{
+			if (opaqueOnly && p.a < 128)
+				continue;
+			const float r = p.r - mean[0], g = p.g - mean[1], b = p.b - mean[2];
+			cov[0] += r * r;
+			cov[1] += r * g;
+			cov[2] += r * b;
+			cov[3] += g * g;
+			cov[4] += g * b;
+			cov[5] += b * b;
+		}
+
+		float v[3] = { (float)(hi.r - lo.r), (float)(hi.g - lo.g), (float)(hi.b - lo.b) };
+		for (int i = 0; i < 4; ++i)
+		{
+			const float x = v[0] * cov[0] + v[1] * cov[1] + v[2] * cov[2];
+			const float y = v[0] * cov[1] + v[1] * cov[3] + v[2] * cov[4];
+			const float z = v[0] * cov[2] + v[1] * cov[4] + v[2] * cov[5];
+			v[0] = x;
+			v[1] = y;
+			v[2] = z;
+		}
+
+		const float largest = std::max({ std::fabs(v[0]), std::fabs(v[1]), std::fabs(v[2]) });
+		if (largest < 1e-4f)
+		{
+			axis[0] = hi.r - lo.r;
+			axis[1] = hi.g - lo.g;
+			axis[2] = hi.b - lo.b;
+			return;
+		}
+		for (int c = 0; c < 3; ++c)
+			axis[c] = (int)std::lround(v[c] * 255.f / largest);
+	}
+
+	// Uses the texels furthest apart along the block's principal axis as endpoints.
+	// With punchThrough, texels with alpha below 128 use the three colour mode's transparent index.
+	void EncodeColorBlock(const block_t& block, bool punchThrough, unsigned char* out)
+	{
+		const kernels_t& kernels = Kernels();
+
+		bool hasTransparent = false;
+		if (punchThrough)
+			for (const rgba8_t& p : block.texels)
+				hasTransparent |= p.a < 128;
+
+		rgba8_t lo, hi;
+		kernels.bounds(block, hasTransparent, lo, hi);
+		if (lo.r > hi.r)
+		{
+			// Nothing but transparent texels, c0 <= c1 selects the three colour mode
+			WriteColorBlock(out, 0, 0, 0xFFFFFFFF);
+			return;
+		}
+
+		int axis[3];
+		PrincipalAxis(block, hasTransparent, lo, hi, axis);
+
+		const int origin[3] = { 0, 0, 0 };
+		int t[16];
+		kernels.project(block, origin, axis, t);
+
+		int first = -1, last = -1;
+		for (int i = 0; i < 16; ++i)
+		{
+			if (hasTransparent && block.texels[i].a < 128)
+				continue;
+			if (first < 0 || t[i] < t[first])
+				first = i;
+			if (last < 0 || t[i] > t[last])
+				last = i;
+		}
+
+		const rgba8_t& pMin = block.texels[first];
+		const rgba8_t& pMax = block.texels[last];
+		const int mn[3] = { pMin.r, pMin.g, pMin.b };
+		const int mx[3] = { pMax.r, pMax.g, pMax.b };
+
+		const u16 cMin = To565(mn), cMax = To565(mx);
+		int eMin[3], eMax[3];
+		From565(cMin, eMin);
+		From565(cMax, eMax);
+
+		const int dir[3] = { eMax[0] - eMin[0], eMax[1] - eMin[1], eMax[2] - eMin[2] };
+		const int dd = dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2];
+
+		u32 indices = 0;
+		if (cMin == cMax || dd == 0)
+		{
+			// A single colour, index 0 everywhere. c0 == c1 is the three colour mode, so transparency still works.
+			if (hasTransparent)
+				for (int i = 0; i < 16; ++i)
+					if (block.texels[i].a < 128)
+						indices |= 3u << (i * 2);
+			WriteColorBlock(out, cMax, cMax, indices);
+			return;
+		}
+
+		kernels.project(block, eMin, dir, t);
+
+		if (!hasTransparent)
+		{
+			// Four colours, c0 has to be the larger one. Positions go from eMin (0) to eMax (3).
+			const bool maxFirst = cMax > cMin;
+			static const u32 c_MAXFIRST[4] = { 1, 3, 2, 0 };
+			static const u32 c_MINFIRST[4] = { 0, 2, 3, 1 };
+			const u32* map = maxFirst ? c_MAXFIRST : c_MINFIRST;
+			for (int i = 0; i < 16; ++i)
+			{
+				const int t6 = t[i] * 6;
+				const int pos = (t6 >= dd) + (t6 >= 3 * dd) + (t6 >= 5 * dd);
+				indices |= map[pos] << (i * 2);
+			}
+			WriteColorBlock(out, maxFirst ? cMax : cMin, maxFirst ? cMin : cMax, indices);
+		}
+		else
+		{
+			// Three colours and transparent, c0 has to be the smaller one. Positions go from eMin (0) to eMax (2).
+			const bool minFirst = cMin < cMax;
+			static const u32 c_MINFIRST[3] = { 0, 2, 1 };
+			static const u32 c_MAXFIRST[3] = { 1, 2, 0 };
+			const u32* map = minFirst ? c_MINFIRST : c_MAXFIRST;
+			for (int i = 0; i < 16; ++i)
+			{
+				u32 index = 3;
+				if (block.texels[i].a >= 128)
+				{
+					const int t4 = t[i] * 4;
+					index = map[(t4 >= dd) + (t4 >= 3 * dd)];
+				}
+				indices |= index << (i * 2);
+			}
+			WriteColorBlock(out, minFirst ? cMin : cMax, minFirst ? cMax : cMin, indices);
+		}
+	}
+
+	// Eight interpolated alpha values between the block's smallest and largest alpha
+	void EncodeAlphaBlock(const block_t& block, unsigned char* out)
+	{
+		int aMin = 255, aMax = 0;
+		for (const rgba8_t& p : block.texels)
+		{
+			aMin = std::min<int>(aMin, p.a);
+			aMax = std::max<int>(aMax, p.a);
+		}
+
+		out[0] = (unsigned char)aMax;
+		out[1] = (unsigned char)aMin;
+		uint64_t indices = 0;
+		if (aMax != aMin)
+		{
+			// Positions go from aMin (0) to aMax (7), index 0 is aMax, 1 is aMin and 2-7 step back down
+			const int range = aMax - aMin;
+			for (int i = 0; i < 16; ++i)
+			{
+				const int a14 = (block.texels[i].a - aMin) * 14;
+				int pos = 0;
+				for (int k = 1; k < 8; ++k)
+					pos += a14 >= (2 * k - 1) * range;
+
+				const uint64_t index = pos == 7 ? 0 : pos == 0 ? 1 : 8 - pos;
+				indices |= index << (i * 3);
+			}
+		}
+		for (int i = 0; i < 6; ++i)
+			out[2 + i] = (unsigned char)(indices >> (i * 8));
+	}
+
+	void DecodeColorBlock(const unsigned char* in, bool alwaysFourColors, rgba8_t out[16])
+	{
+		const u16 c0 = (u16)(in[0] | (in[1] << 8));
+		const u16 c1 = (u16)(in[2] | (in[3] << 8));
+		int e0[3], e1[3];
+		From565(c0, e0);
+		From565(c1, e1);
+
+		rgba8_t palette[4];
+		palette[0] = { (unsigned char)e0[0], (unsigned char)e0[1], (unsigned char)e0[2], 255 };
+		palette[1] = { (unsigned char)e1[0], (unsigned char)e1[1], (unsigned char)e1[2], 255 };
+		if (c0 > c1 || alwaysFourColors)
+		{
+			palette[2] = { (unsigned char)((2 * e0[0] + e1[0]) / 3), (unsigned char)((2 * e0[1] + e1[1]) / 3), (unsigned char)((2 * e0[2] + e1[2]) / 3), 255 };
+			palette[3] = { (unsigned char)((e0[0] + 2 * e1[0]) / 3), (unsigned char)((e0[1] + 2 * e1[1]) / 3), (unsigned char)((e0[2] + 2 * e1[2]) / 3), 255 };
+		}
+		else
+		{
+			palette[2] = { (unsigned char)((e0[0] + e1[0]) / 2), (unsigned char)((e0[1] + e1[1]) / 2), (unsigned char)((e0[2] + e1[2]) / 2), 255 };
+			palette[3] = { 0, 0, 0, 0 };
+		}
+
+		const u32 indices = in[4] | (in[5] << 8) | (in[6] << 16) | ((u32)in[7] << 24);
+		for (int i = 0; i < 16; ++i)
+			out[i] = palette[(indices >> (i * 2)) & 3];
+	}
+
+	void DecodeAlphaBlock(const unsigned char* in, rgba8_t out[16])
+	{
+		const int a0 = in[0], a1 = in[1];
+		int palette[8] = { a0, a1 };
+		if (a0 > a1)
+		{
+			for (int i = 1; i < 7; ++i)
+				palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+		}
+		else
+		{
+			for (int i = 1; i < 5; ++i)
+				palette[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+
+		uint64_t indices = 0;
+		for (int i = 0; i < 6; ++i)
+			indices |= (uint64_t)in[2 + i] << (i * 8);
+		for (int i = 0; i < 16; ++i)
+			out[i].a = (unsigned char)palette[(indices >> (i * 3)) & 7];
+	}
+
+	size_t GetBlockSize(EBlockFormat format)
+	{
+		return format == EBlockFormat::BC1 ? 8 : 16;
+	}
+}
+
+size_t GetCompressedSize(EBlockFormat format, unsigned int w, unsigned int h)
+{
+	return (size_t)(w / 4) * (h / 4) * GetBlockSize(format);
+}
+
+EBlockFormat ChooseBlockFormat(const texture_t& image)
+{
+	return ChooseBlockFormat(image, { 0, 0, (int)image.w, (int)image.h });
+}
+
+EBlockFormat ChooseBlockFormat(const texture_t& image, const sheetrect_t& rect)
+{
+	for (int y = rect.y0; y < rect.y1; ++y)
+	{
+		const rgba8_t* row = &image.pixels[(size_t)y * image.w];
+		for (int x = rect.x0; x < rect.x1; ++x)
+			if (row[x].a != 0 && row[x].a != 255)
+				return EBlockFormat::BC3;
+	}
+	return EBlockFormat::BC1;
+}
+
+void CompressImage(const texture_t& image, EBlockFormat format, unsigned char* dst)
+{
+	CompressRect(image, format, { 0, 0, (int)image.w, (int)image.h }, dst);
+}
+
+void CompressRect(const texture_t& image, EBlockFormat format, const sheetrect_t& rect, unsigned char* dst)
+{
+	const u32 blocksX = image.w / 4;
+	const size_t blockSize = GetBlockSize(format);
+	ThreadPool::Get().ParallelFor((rect.y1 - rect.y0) / 4, [&](size_t row)
+		{
+			const size_t by = rect.y0 / 4 + row;
+			block_t block;
+			for (u32 bx = rect.x0 / 4; bx < (u32)rect.x1 / 4; ++bx)
+			{
+				for (int y = 0; y < 4; ++y)
+					memcpy(&block.texels[y * 4], &image.pixels[(by * 4 + y) * image.w + bx * 4], 4 * sizeof(rgba8_t));
+
+				unsigned char* out = dst + (by * blocksX + bx) * blockSize;
+				if (format == EBlockFormat::BC3)
+				{
+					EncodeAlphaBlock(block, out);
+					EncodeColorBlock(block, false, out + 8);
+				}
+				else
+				{
+					EncodeColorBlock(block, true, out);
+				}
+			}
+		});
+}
+
+void DecompressImage(const unsigned char* src, EBlockFormat format, texture_t& image)
+{
+	const u32 blocksX = image.w / 4;
+	const size_t blockSize = GetBlockSize(format);
+	for (u32 by = 0; by < image.h / 4; ++by)
+	{
+		for (u32 bx = 0; bx < blocksX; ++bx)
+		{
+			const unsigned char* in = src + (by * blocksX + bx) * blockSize;
+			rgba8_t texels[16];
+			if (format == EBlockFormat::BC3)
+			{
+				DecodeColorBlock(in + 8, true, texels);
+				DecodeAlphaBlock(in, texels);
+			}
+			else
+			{
+				DecodeColorBlock(in, false, texels);
+			}
+
+			for (int y = 0; y < 4; ++y)
+				memcpy(&image.pixels[(by * 4 + y) * image.w + bx * 4], &texels[y * 4], 4 * sizeof(rgba8_t));
+		}
+	}
+}
+
+double ComputePSNR(const rgba8_t* a, const rgba8_t* b, size_t count)
+{
+	double sum = 0.0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		const int dr = a[i].r - b[i].r, dg = a[i].g - b[i].g, db = a[i].b - b[i].b, da = a[i].a - b[i].a;
+		sum += dr * dr + dg * dg + db * db + da * da;
+	}
+
+	if (sum == 0.0)
+		return std::numeric_limits<double>::infinity();
+
+	const double mse = sum / (count * 4.0);
+	return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "mapreader.h"
+
+enum class EBlockFormat
+{
+	BC1, // 4 bits per texel, colour plus a single bit of alpha
+	BC3  // 8 bits per texel, colour plus interpolated alpha
+};
+
+// Size in bytes of a w x h image (both multiples of 4) in the given format
+size_t GetCompressedSize(EBlockFormat format, unsigned int w, unsigned int h);
+
+// BC1 if every texel is either fully opaque or fully transparent, BC3 if anything needs more than that
+EBlockFormat ChooseBlockFormat(const texture_t& image);
+
+// Same, only looking at the texels in rect
+EBlockFormat ChooseBlockFormat(const texture_t& image, const sheetrect_t& rect);
+
+// Compresses the image (w and h multiples of 4) into dst, which has to hold GetCompressedSize bytes.
+// Rows of blocks are spread over the thread pool.
+void CompressImage(const texture_t& image, EBlockFormat format, unsigned char* dst);
+
+// Compresses only the blocks rect (a multiple of 4 in every coordinate) covers into dst, which holds the
+// whole image as CompressImage writes it. The other blocks are left as they are.
+void CompressRect(const texture_t& image, EBlockFormat format, const sheetrect_t& rect, unsigned char* dst);
+
+// Decompresses into image, which already has its size and pixels set. Mostly there to check the encoder.
+void DecompressImage(const unsigned char* src, EBlockFormat format, texture_t& image);
+
+// Peak signal to noise ratio of b against a over all four channels in dB, infinity if they are the same
+double ComputePSNR(const rgba8_t* a, const rgba8_t* b, size_t count);
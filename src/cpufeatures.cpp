@@ -0,0 +1,69 @@
+#include "cpufeatures.h"
+
+#if defined(CPU_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace
+{
+	struct features_t
+	{
+		bool sse2 = false;
+		bool avx2 = false;
+		bool neon = false;
+	};
+
+	features_t Detect()
+	{
+		features_t f;
+#if defined(CPU_X86)
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		const int maxLeaf = info[0];
+
+		__cpuid(info, 1);
+		f.sse2 = (info[3] & (1 << 26)) != 0;
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		const bool avx = (info[2] & (1 << 28)) != 0;
+
+		if (maxLeaf >= 7 && osxsave && avx)
+		{
+			// The OS has to save the YMM registers too, otherwise AVX is off limits
+			const bool ymmEnabled = (_xgetbv(0) & 0x6) == 0x6;
+			__cpuidex(info, 7, 0);
+			f.avx2 = ymmEnabled && (info[1] & (1 << 5)) != 0;
+		}
+#else
+		__builtin_cpu_init();
+		f.sse2 = __builtin_cpu_supports("sse2");
+		f.avx2 = __builtin_cpu_supports("avx2");
+#endif
+#elif defined(CPU_NEON)
+		// Part of the base ISA on AArch64
+		f.neon = true;
+#endif
+		return f;
+	}
+
+	const features_t& Features()
+	{
+		static const features_t features = Detect();
+		return features;
+	}
+}
+
+bool CPU::HasSSE2()
+{
+	return Features().sse2;
+}
+
+bool CPU::HasAVX2()
+{
+	return Features().avx2;
+}
+
+bool CPU::HasNEON()
+{
+	return Features().neon;
+}
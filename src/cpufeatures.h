@@ -0,0 +1,27 @@
+#pragma once
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CPU_X86 1
+#endif
+
+#if defined(_M_ARM64) || defined(__aarch64__) || defined(__ARM_NEON)
+#define CPU_NEON 1
+#endif
+
+// GCC and Clang only emit instructions the function was compiled for, so kernels for
+// anything past the baseline need to be tagged. MSVC doesn't need (or have) this.
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#endif
+
+// Checked once on first use, kernels are picked based on these
+namespace CPU
+{
+	bool HasSSE2();
+	bool HasAVX2();
+	bool HasNEON();
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include "records.h"
+
+using byte = unsigned char;
+using u16 = unsigned short;
+using u32 = unsigned int;
+using i16 = signed short;
+using i32 = signed int;
+using addr_t = u32;
+
+// Record layouts of the DFX tables. All addresses are relative to the level data base.
+namespace DFX
+{
+	// Level and object vertices: x, y, z, normal id, r, g, b, a
+	using VertexRecord = record_t<12,
+		field_t<i16, 0>, field_t<i16, 2>, field_t<i16, 4>,
+		field_t<u16, 6>,
+		field_t<byte, 8>, field_t<byte, 9>, field_t<byte, 10>, field_t<byte, 11>>;
+
+	// Level polygons: 3 vertex indices, flags, material address
+	using LevelPolygonRecord = record_t<0x14,
+		field_t<u16, 0>, field_t<u16, 2>, field_t<u16, 4>,
+		field_t<byte, 7>,
+		field_t<addr_t, 0x10>>;
+
+	// Object polygons: 3 vertex indices, flags, then either a material address (flags & 2)
+	// or 4 colour bytes, so the last field is kept raw
+	using ObjectPolygonRecord = record_t<0x0C,
+		field_t<u16, 0>, field_t<u16, 2>, field_t<u16, 4>,
+		field_t<byte, 7>,
+		field_t<u32, 8>>;
+
+	// Materials: u0, v0, flags, u1, v1, texture id, u2, v2
+	using MaterialRecord = record_t<10,
+		field_t<byte, 0>, field_t<byte, 1>,
+		field_t<byte, 2>,
+		field_t<byte, 4>, field_t<byte, 5>,
+		field_t<u16, 6>,
+		field_t<byte, 8>, field_t<byte, 9>>;
+
+	// Skybox parts: polygon count, vertex table, polygon table, vertex count
+	using SkyboxRecord = record_t<24,
+		field_t<u16, 2>, field_t<addr_t, 4>, field_t<addr_t, 8>, field_t<u32, 20>>;
+
+	// Skybox vertices: x, y, z, normal id
+	using SkyboxVertexRecord = record_t<8,
+		field_t<i16, 0>, field_t<i16, 2>, field_t<i16, 4>, field_t<u16, 6>>;
+
+	// Skybox polygons: 3 vertex indices, flags, material address
+	using SkyboxPolygonRecord = record_t<12,
+		field_t<u16, 0>, field_t<u16, 2>, field_t<u16, 4>, field_t<u16, 6>, field_t<addr_t, 8>>;
+
+	// Level geometry header: bsp, vertex/polygon/vertex colour counts, then their tables and the materials
+	using LevelGeometryRecord = record_t<0x34,
+		field_t<addr_t, 0>,
+		field_t<u32, 0x18>, field_t<u32, 0x1C>, field_t<u32, 0x20>,
+		field_t<addr_t, 0x24>, field_t<addr_t, 0x28>, field_t<addr_t, 0x2C>, field_t<addr_t, 0x30>>;
+
+	// Model header: object count, object table, name
+	using ModelRecord = record_t<0x28,
+		field_t<u16, 8>, field_t<addr_t, 12>, field_t<addr_t, 0x24>>;
+
+	// Model sub-objects: vertex count/table, polygon count/table, bone count/table, texture animations
+	using ObjectRecord = record_t<36,
+		field_t<u16, 0>, field_t<addr_t, 4>,
+		field_t<u16, 16>, field_t<addr_t, 20>,
+		field_t<u16, 24>, field_t<addr_t, 28>,
+		field_t<addr_t, 32>>;
+
+	// Object instances: model, rotation x/y/z, position x/y/z, 4 words of per type data
+	using InstanceRecord = record_t<0x30,
+		field_t<addr_t, 0>,
+		field_t<i16, 10>, field_t<i16, 12>, field_t<i16, 14>,
+		field_t<i16, 16>, field_t<i16, 18>, field_t<i16, 20>,
+		field_t<u32, 0x20>, field_t<u32, 0x24>, field_t<u32, 0x28>, field_t<u32, 0x2C>>;
+
+	// Moving platforms: path, rotation list
+	using PlatformRecord = record_t<8, field_t<addr_t, 0>, field_t<addr_t, 4>>;
+
+	// Paths and rotation lists share the same header: table, count
+	using ListRecord = record_t<6, field_t<addr_t, 0>, field_t<u16, 4>>;
+
+	// Path points: speed, x, y, z
+	using PathPointRecord = record_t<0x20,
+		field_t<u16, 0>, field_t<i16, 2>, field_t<i16, 4>, field_t<i16, 6>>;
+
+	// Path rotations: speed, quaternion in 4.12 fixed point
+	using PathRotationRecord = record_t<10,
+		field_t<u16, 0>, field_t<i16, 2>, field_t<i16, 4>, field_t<i16, 6>, field_t<i16, 8>>;
+}
@@ -0,0 +1,118 @@
+#include "filereader.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+bool MapFile(const std::string& filepath, file_t& file, EFileAccess access)
+{
+#ifdef _WIN32
+	const DWORD flags = access == EFileAccess::Sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS;
+	HANDLE hFile = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | flags, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(hFile, &size) || size.QuadPart == 0 || (unsigned long long)size.QuadPart > SIZE_MAX)
+	{
+		CloseHandle(hFile);
+		return false;
+	}
+
+	HANDLE hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(hFile);
+	if (hMapping == NULL)
+		return false;
+
+	// The view keeps the mapping alive, so both handles can go right away
+	void* view = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(hMapping);
+	if (view == NULL)
+		return false;
+
+	file.data = (const file_t::data_t*)view;
+	file.size = (size_t)size.QuadPart;
+#else
+	int fd = open(filepath.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		close(fd);
+		return false;
+	}
+
+	void* view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (view == MAP_FAILED)
+		return false;
+
+	madvise(view, (size_t)st.st_size, access == EFileAccess::Sequential ? MADV_SEQUENTIAL : MADV_WILLNEED);
+
+	file.data = (const file_t::data_t*)view;
+	file.size = (size_t)st.st_size;
+#endif
+	file.mapped = true;
+	return true;
+}
+
+bool ReadFileBuffered(const std::string& filepath, file_t& file)
+{
+	FILE* f = NULL;
+	fopen_s(&f, filepath.c_str(), "rb");
+	if (f)
+	{
+		fseek(f, 0, SEEK_END);
+		file.size = ftell(f);
+		fseek(f, 0, SEEK_SET);
+		file_t::data_t* buffer = new file_t::data_t[file.size];
+		fread(buffer, file.size, 1, f);
+		fclose(f);
+		file.data = buffer;
+		file.mapped = false;
+		return true;
+	}
+
+	file.data = NULL;
+	return false;
+}
+
+bool ReadFile(const std::string& filepath, file_t& file, EFileAccess access)
+{
+	file.Close();
+
+	if (MapFile(filepath, file, access))
+		return true;
+
+	return ReadFileBuffered(filepath, file);
+}
+
+void file_t::Close()
+{
+	if (data)
+	{
+		if (mapped)
+		{
+#ifdef _WIN32
+			UnmapViewOfFile(data);
+#else
+			munmap((void*)data, size);
+#endif
+		}
+		else
+			delete[] data;
+	}
+	data = nullptr;
+	size = 0;
+	baseOffset = 0;
+	mapped = false;
+}
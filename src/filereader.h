@@ -0,0 +1,143 @@
+#pragma once
+#include <bit>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+
+// Same as std::byteswap (C++23), but also takes enums and floats
+template<typename T>
+inline T ByteSwap(T value)
+{
+	static_assert(std::is_trivially_copyable_v<T>);
+	if constexpr (sizeof(T) > 1)
+	{
+		unsigned char bytes[sizeof(T)];
+		memcpy(bytes, &value, sizeof(T));
+		for (size_t i = 0; i < sizeof(T) / 2; ++i)
+		{
+			const unsigned char b = bytes[i];
+			bytes[i] = bytes[sizeof(T) - i - 1];
+			bytes[sizeof(T) - i - 1] = b;
+		}
+		memcpy(&value, bytes, sizeof(T));
+	}
+	return value;
+}
+
+// Game files are little endian, so this does nothing on pretty much everything we run on
+template<typename T>
+inline T FromLittleEndian(T value)
+{
+	if constexpr (std::endian::native == std::endian::big)
+		return ByteSwap(value);
+	else
+		return value;
+}
+
+// A view over a range of file data that was bounds checked once when it was created.
+// Reads inside the range are unchecked, so only ever read what was asked for.
+// Cheap to copy around, never allocates.
+struct cursor_t
+{
+	const unsigned char* data = nullptr;
+	size_t size = 0;
+	size_t pos = 0;
+
+	explicit operator bool() const { return data != nullptr; }
+
+	template<typename T>
+	T Read(size_t offset) const
+	{
+		T value;
+		memcpy(&value, data + offset, sizeof(T));
+		return FromLittleEndian(value);
+	}
+
+	// Reads at the current position and moves past the value
+	template<typename T>
+	T Next()
+	{
+		T value = Read<T>(pos);
+		pos += sizeof(T);
+		return value;
+	}
+
+	void Skip(size_t count) { pos += count; }
+
+	// Bulk copy followed by a single swap pass (if one is even needed)
+	template<typename T>
+	void ReadArray(size_t offset, T* out, size_t count) const
+	{
+		memcpy(out, data + offset, sizeof(T) * count);
+		if constexpr (std::endian::native == std::endian::big && sizeof(T) > 1)
+		{
+			for (size_t i = 0; i < count; ++i)
+				out[i] = ByteSwap(out[i]);
+		}
+	}
+
+	template<typename T = unsigned char>
+	const T* ptr(size_t offset = 0) const { return (const T*)(data + offset); }
+
+	// Checked, returns an empty cursor if the range doesn't fit in this one
+	cursor_t Sub(size_t offset, size_t length) const
+	{
+		if (offset > size || length > size - offset)
+			return {};
+		return { data + offset, length };
+	}
+
+	// Unchecked, for indexing into a table that was validated as a whole
+	cursor_t Record(size_t index, size_t stride) const
+	{
+		return { data + index * stride, stride };
+	}
+};
+
+struct file_t
+{
+	using data_t = unsigned char;
+	const data_t* data = nullptr;
+	size_t size = 0;
+	size_t baseOffset = 0;
+
+	// True when data is a read-only view of the file mapped in memory,
+	// false when it was read into a heap buffer
+	bool mapped = false;
+
+	file_t() = default;
+	file_t(const file_t&) = delete;
+	file_t& operator=(const file_t&) = delete;
+
+	// Validated view of [baseOffset + offset, baseOffset + offset + length).
+	// Returns an empty cursor if any of it lies outside the file.
+	cursor_t At(size_t offset, size_t length) const
+	{
+		if (baseOffset > size || offset > size - baseOffset || length > size - baseOffset - offset)
+		{
+#ifdef DEBUG
+			printf("READ OUT OF BOUNDS! %zx + %zx > %zx!\n", baseOffset + offset, length, size);
+#endif
+			return {};
+		}
+		return { data + baseOffset + offset, length };
+	}
+
+	void Close();
+
+	~file_t()
+	{
+		Close();
+	}
+};
+
+// How the file is going to be walked, used as a hint for the OS when the file is mapped
+enum class EFileAccess
+{
+	Random,		// jumps all over the place, like the DFX address tables
+	Sequential	// read front to back once, like the VFX texture list
+};
+
+// Maps the file read-only if possible, otherwise falls back to reading it into a heap buffer
+bool ReadFile(const std::string& filepath, file_t& file, EFileAccess access = EFileAccess::Random);
@@ -1,5 +1,6 @@
 #include "imagepacker.h"
 #include <algorithm>
+#include <climits>
 
 constexpr int c_MAXIMAGESIZE = 4096;
 
@@ -110,6 +111,137 @@ bool CreateAtlas(ImagePacker::ImageInformationList& list, int size)
 	return true;
 }
 
+// Bottom-left skyline packer. The skyline is the top edge of everything placed so far, kept as a flat
+// list of horizontal segments from left to right, so trying again at a bigger size only clears it.
+class Skyline
+{
+public:
+	void Reset(int size)
+	{
+		this->size = size;
+		segments.clear();
+		segments.push_back({ 0, 0, size });
+	}
+
+	// Puts the image where its top ends up lowest, the narrower spot on ties
+	bool AddImage(ImagePacker::ImageInformation_t& info)
+	{
+		size_t bestIndex = segments.size();
+		int bestY = 0, bestTop = INT_MAX, bestWidth = INT_MAX;
+		for (size_t i = 0; i < segments.size(); ++i)
+		{
+			int y;
+			if (!Fits(i, info.width, info.height, y))
+				continue;
+
+			const int top = y + info.height;
+			if (top < bestTop || (top == bestTop && segments[i].width < bestWidth))
+			{
+				bestIndex = i;
+				bestY = y;
+				bestTop = top;
+				bestWidth = segments[i].width;
+			}
+		}
+
+		if (bestIndex == segments.size())
+			return false;
+
+		info.x = segments[bestIndex].x;
+		info.y = bestY;
+		Place(bestIndex, info.width, bestTop);
+		return true;
+	}
+
+private:
+	struct segment_t
+	{
+		int x, y, width;
+	};
+
+	// Height a w x h image would rest at with its left edge on segment i, false if it doesn't fit there
+	bool Fits(size_t i, int w, int h, int& y) const
+	{
+		if (segments[i].x + w > size)
+			return false;
+
+		y = 0;
+		for (int covered = 0; covered < w; covered += segments[i++].width)
+		{
+			y = std::max(y, segments[i].y);
+			if (y + h > size)
+				return false;
+		}
+		return true;
+	}
+
+	// Raises the skyline to top over w texels from segment index on
+	void Place(size_t index, int w, int top)
+	{
+		const int x = segments[index].x;
+		segments.insert(segments.begin() + index, { x, top, w });
+
+		// Cut the covered segments away, the last one might only lose its left part
+		const size_t next = index + 1;
+		while (next < segments.size() && segments[next].x < x + w)
+		{
+			segment_t& segment = segments[next];
+			const int covered = x + w - segment.x;
+			if (covered < segment.width)
+			{
+				segment.x += covered;
+				segment.width -= covered;
+				break;
+			}
+			segments.erase(segments.begin() + next);
+		}
+
+		// Neighbours at the same height become one segment
+		for (size_t i = index > 0 ? index - 1 : 0; i + 1 < segments.size() && i <= index + 1;)
+		{
+			if (segments[i].y == segments[i + 1].y)
+			{
+				segments[i].width += segments[i + 1].width;
+				segments.erase(segments.begin() + i + 1);
+			}
+			else
+				++i;
+		}
+	}
+
+	int size = 0;
+	std::vector<segment_t> segments;
+};
+
+int PackSkyline(ImagePacker::ImageInformationList& list, int imageStartSizeHint)
+{
+	// Tallest first, then widest, so the skyline stays as flat as possible
+	std::stable_sort(list.begin(), list.end(), [](const ImagePacker::ImageInformation_t& a, const ImagePacker::ImageInformation_t& b)
+		{
+			return a.height != b.height ? a.height > b.height : a.width > b.width;
+		});
+
+	Skyline skyline;
+	for (int size = imageStartSizeHint; size <= c_MAXIMAGESIZE; size <<= 1)
+	{
+		skyline.Reset(size);
+		bool packed = true;
+		for (auto& info : list)
+		{
+			if (!skyline.AddImage(info))
+			{
+				packed = false;
+				break;
+			}
+		}
+
+		if (packed)
+			return size;
+	}
+
+	return 0;
+}
+
 int ImagePacker::GeneratePackedList(ImageInformationList& list, int imageStartSizeHint)
 {
 	int size = imageStartSizeHint;
@@ -145,4 +277,25 @@ int ImagePacker::GeneratePackedList(ImageInformationList& list, int imageStartSi
 int ImagePacker::GeneratePackedList(ImageInformationList& list)
 {
 	return GeneratePackedList(list, 64);
+}
+
+int ImagePacker::GeneratePackedList(ImageInformationList& list, int imageStartSizeHint, int padding, EStrategy strategy)
+{
+	// Packed as if every image was bigger by the border, then moved back inside it
+	for (auto& info : list)
+	{
+		info.width += padding * 2;
+		info.height += padding * 2;
+	}
+
+	const int size = strategy == EStrategy::Skyline ? PackSkyline(list, imageStartSizeHint) : GeneratePackedList(list, imageStartSizeHint);
+
+	for (auto& info : list)
+	{
+		info.width -= padding * 2;
+		info.height -= padding * 2;
+		info.x += padding;
+		info.y += padding;
+	}
+	return size;
 }
\ No newline at end of file
@@ -3,6 +3,9 @@
 
 namespace ImagePacker
 {
+    // Bumped whenever the same list would get packed differently, cached layouts go stale with it
+    constexpr int Version = 1;
+
     struct ImageInformation_t
     {
         // User provided:
@@ -21,4 +24,14 @@ namespace ImagePacker
     // Returns the image size, or 0 if generation failed. Defaults to 64x64
     int GeneratePackedList(ImageInformationList& list);
     int GeneratePackedList(ImageInformationList& list, int imageStartSizeHint);
+
+    enum class EStrategy
+    {
+        AtlasTree, // Rows of shelves that images get pushed into from the left
+        Skyline    // Bottom-left skyline, a flat list of segments instead of a tree of nodes
+    };
+
+    // Same, but keeps a border of padding pixels free around every image. x and y still point at
+    // the image itself, the border is left for the caller to fill (e.g. with the image's edges)
+    int GeneratePackedList(ImageInformationList& list, int imageStartSizeHint, int padding, EStrategy strategy = EStrategy::AtlasTree);
 }
\ No newline at end of file
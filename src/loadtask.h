@@ -0,0 +1,80 @@
+#pragma once
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+enum class ELoadStage
+{
+	Opening,  // Mapping the DFX
+	Decoding, // Textures and geometry, side by side
+	Mapping,  // Cutouts, textures that waited on the geometry and the mips
+	Done
+};
+
+inline const char* GetLoadStageName(ELoadStage stage)
+{
+	switch (stage)
+	{
+	case ELoadStage::Opening:  return "Opening files";
+	case ELoadStage::Decoding: return "Decoding textures and geometry";
+	case ELoadStage::Mapping:  return "Finishing the texture sheet";
+	default:                   return "Done";
+	}
+}
+
+// Coroutine that runs a level load one stage at a time. Each Resume runs a single stage, so whoever
+// drives it can report the stage in between and cancel by simply not resuming (or destroying) it.
+class LoadTask
+{
+public:
+	struct promise_type
+	{
+		ELoadStage stage = ELoadStage::Opening;
+		bool result = false;
+
+		LoadTask get_return_object() { return LoadTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		std::suspend_always final_suspend() noexcept { return {}; }
+		std::suspend_always yield_value(ELoadStage next) noexcept { stage = next; return {}; }
+		void return_value(bool succeeded) noexcept { result = succeeded; stage = ELoadStage::Done; }
+		void unhandled_exception() noexcept { std::terminate(); }
+	};
+
+	LoadTask(LoadTask&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+	LoadTask& operator=(LoadTask&& other) noexcept
+	{
+		if (this != &other)
+		{
+			if (handle)
+				handle.destroy();
+			handle = std::exchange(other.handle, nullptr);
+		}
+		return *this;
+	}
+	LoadTask(const LoadTask&) = delete;
+	LoadTask& operator=(const LoadTask&) = delete;
+	~LoadTask()
+	{
+		if (handle)
+			handle.destroy();
+	}
+
+	// Runs the next stage, returns false once the load has finished
+	bool Resume()
+	{
+		if (!handle || handle.done())
+			return false;
+		handle.resume();
+		return !handle.done();
+	}
+
+	// The stage the next Resume will run
+	ELoadStage GetStage() const { return handle ? handle.promise().stage : ELoadStage::Done; }
+	bool IsDone() const { return !handle || handle.done(); }
+	bool GetResult() const { return handle && handle.done() && handle.promise().result; }
+
+private:
+	explicit LoadTask(std::coroutine_handle<promise_type> h) : handle(h) {}
+
+	std::coroutine_handle<promise_type> handle;
+};
@@ -1,5 +1,7 @@
 #include "shader.h"
 #include "mapreader.h"
+#include "objectregistry.h"
+#include "blockcompress.h"
 
 #ifdef _WIN32
 #include <Windows.h>
@@ -25,6 +27,9 @@
 
 #include <fstream>
 #include <string>
+#include <thread>
+#include <atomic>
+#include <algorithm>
 
 #ifdef _WIN32
 std::string OpenLoadPrompt(const char* filter)
@@ -70,7 +75,8 @@ struct Vertex
 {
     glm::vec3 position;
     glm::vec4 color;
-    glm::vec2 uv;
+    glm::vec2 uv;    // Relative to the polygon's texture
+    float material;  // Slot in the material rectangle table, -1 if untextured
 };
 
 glm::vec3 GetUpVector()
@@ -102,6 +108,11 @@ struct sleveldata_t
 {
     level_t level;
     GLuint texid = 0;
+    GLuint rectid = 0; // Sheet rectangle of every material, see UploadMaterialRects
+    // Blocks of every level of the sheet while it's uploaded compressed, so a change to the sheet
+    // only needs the blocks under it encoded again
+    std::vector<std::vector<unsigned char>> sheetBlocks;
+    EBlockFormat sheetFormat = EBlockFormat::BC1;
     bool open = false;
 };
 
@@ -126,6 +137,9 @@ bool wireframe = false;
 bool texturesVis = true;
 bool vertexCols = true;
 bool noObjects = false;
+bool lazyObjects = false;
+bool lazyTextures = false;
+bool compressTextures = false;
 bool enableBillboarding = true;
 
 void SetWireframe(bool state)
@@ -194,80 +208,8 @@ bool IsBillboardObject(const std::string& name)
     if (name[0] == '$')
         return true;
 
-    const char* BillboardObjectNames[] = {
-        "nflame__",
-        "mflame__",
-
-        "charger_",
-        "steam___",
-
-        "cold____",
-
-        "proxsig_",
-        "@Path",
-
-        /// COLLECTIBLES
-        // Aztec 2 Step
-        "gem_____",
-
-        // I Got the Reruns
-        "coltv___",
-
-        // Trouble in Uranus
-        "saucer__",
-
-        // In Drag Net
-        "badge___",
-
-        // The Spy Who Loved Himself
-        "case____",
-
-        // Circuit Central
-        "batt____", // Chips and Dips
-        "led_____",
-        "atom____",
-
-        // Scream TV
-        "skull___", // Thursday the 12th
-        "tomb____",
-        "jason___",
-
-        // Kung-Fu Theatre
-        "takeout_", // Lizard in a China Shop
-        "yinyang_",
-        "kabuki__",
-
-        // Toon TV
-        "carrot__",
-        "spinach_",
-        "plunge__",
-
-        // Prehistory Channel
-        "drum____",
-        "cowhead_",
-        "dino____",
-
-        // Space Channel
-        "ship____",
-        "phaser__",
-        "robot___"
-
-        // Mazed and Confused (Rezop 1)
-        "cd______",
-        "radiate_", // Bugged Out
-        "camera__",
-
-        // No Weddings and a Funeral (Rezop 3)
-        "gear____",
-        "toolbox_",
-        "oilcan__",
-    };
-    const char** pENDPTR = BillboardObjectNames + sizeof(BillboardObjectNames) / sizeof(const char*);
-
-    return std::find_if(BillboardObjectNames, pENDPTR,
-        [&name](const char* objName) {
-            return name == objName;
-        }) != pENDPTR;
+    const objecttype_t* type = FindObjectType(name);
+    return type && (type->flags & OBJECT_BILLBOARD);
 }
 
 struct globj_t
@@ -284,6 +226,8 @@ struct globj_t
         glEnableVertexAttribArray(1);
         glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(sizeof(glm::vec3) + sizeof(glm::vec4)));
         glEnableVertexAttribArray(2);
+        glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(sizeof(glm::vec3) + sizeof(glm::vec4) + sizeof(glm::vec2)));
+        glEnableVertexAttribArray(3);
 
         glm::mat4 Model = glm::translate(glm::mat4(1.f), -inst.position);
         bool doBillboarding = enableBillboarding && IsBillboardObject(name);
@@ -303,6 +247,10 @@ struct globj_t
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, leveldata.texid);
         glUniform1i(glGetUniformLocation(program, "uTexture"), 0);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, leveldata.rectid);
+        glUniform1i(glGetUniformLocation(program, "uMaterialRects"), 1);
+        glActiveTexture(GL_TEXTURE0);
         // extra hack for billboarding transparency
         // todo: hopefully remove with fixed textures
         glUniform1i(glGetUniformLocation(program, "uBillboard"), (int)doBillboarding);
@@ -319,26 +267,26 @@ void CloseLevel(sleveldata_t& leveldata)
     if (leveldata.texid != 0)
         glDeleteTextures(1, &leveldata.texid);
     leveldata.texid = 0;
-    for (auto& tex : leveldata.level.textures)
-        if (tex.deletePixels)
-            delete[] tex.pixels;
-    leveldata.level.textures.clear();
-    leveldata.level.models.clear();
-    leveldata.level.paths.clear();
+    if (leveldata.rectid != 0)
+        glDeleteTextures(1, &leveldata.rectid);
+    leveldata.rectid = 0;
+    leveldata.sheetBlocks.clear();
+    FreeLevel(leveldata.level);
     leveldata.open = false;
     mdls.clear();
 }
 
-std::shared_ptr<globj_t> createobj(std::shared_ptr<Model> model)
+std::shared_ptr<globj_t> createobj(const level_t& level, std::shared_ptr<Model> model)
 {
     auto ptr = std::make_shared<globj_t>();
 
     for (auto& p : model->polygons)
     {
+        const float material = (float)GetMaterialSlot(level, p.materialID);
         for (int i = 0; i < 3; ++i)
         {
             auto& v = model->vertices[p.vertex[i]];
-            ptr->vertices.push_back({ {v.x / 1000.f, v.y / 1000.f, v.z / 1000.f}, {v.r / 255.f, v.g / 255.f, v.b / 255.f, v.a / 255.f}, p.uvs[i] });
+            ptr->vertices.push_back({ {v.x / 1000.f, v.y / 1000.f, v.z / 1000.f}, {v.r / 255.f, v.g / 255.f, v.b / 255.f, v.a / 255.f}, p.uvs[i], material });
             if (p.materialID == 0xFFFF'FFFF)
                 if (model->hasNoTextures)
                 {
@@ -361,18 +309,183 @@ std::shared_ptr<globj_t> createobj(std::shared_ptr<Model> model)
     return ptr;
 }
 
-ImVec4 bgColor = { 0xBB / 255.f, 0xF6 / 255.f, 0xF7 / 255.f, 255 };
+// Not in our glad headers, they come from EXT_texture_compression_s3tc
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
 
-std::string levelPath, levelName;
-bool OpenLevel(const char* levelPath, sleveldata_t& leveldata)
+bool SupportsCompressedFormat(GLenum format)
 {
-    CloseLevel(leveldata);
-    printf("Loading level \"%s\"\n", levelPath);
-    if (!LoadLevel(levelPath, leveldata.level))
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &count);
+    std::vector<GLint> formats(count);
+    if (count > 0)
+        glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, formats.data());
+    return std::find(formats.begin(), formats.end(), (GLint)format) != formats.end();
+}
+
+GLenum GetGLFormat(EBlockFormat format)
+{
+    return format == EBlockFormat::BC1 ? GL_COMPRESSED_RGBA_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+}
+
+// Compresses every level of the sheet on the CPU and uploads the blocks, false if the driver can't take them.
+// The blocks are kept in leveldata for UpdateCompressedSheet.
+bool UploadCompressedSheet(sleveldata_t& leveldata)
+{
+    const level_t& level = leveldata.level;
+    if (level.sheet.w % 4 != 0 || level.sheet.h % 4 != 0)
+        return false;
+    for (const auto& mip : level.sheetMips)
+        if (mip.w % 4 != 0 || mip.h % 4 != 0)
+            return false;
+
+    const EBlockFormat format = ChooseBlockFormat(level.sheet);
+    if (!SupportsCompressedFormat(GetGLFormat(format)))
     {
-        ::levelPath = levelName = "";
+        printf("Compressed textures aren't supported, uploading the sheet as is\n");
+        return false;
+    }
+
+    leveldata.sheetFormat = format;
+    leveldata.sheetBlocks.resize(level.sheetMips.size() + 1);
+    for (size_t i = 0; i < leveldata.sheetBlocks.size(); ++i)
+    {
+        const texture_t& image = i == 0 ? level.sheet : level.sheetMips[i - 1];
+        auto& blocks = leveldata.sheetBlocks[i];
+        blocks.resize(GetCompressedSize(format, image.w, image.h));
+        CompressImage(image, format, blocks.data());
+        glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)i, GetGLFormat(format), image.w, image.h, 0, (GLsizei)blocks.size(), blocks.data());
+    }
+    return true;
+}
+
+// Encodes and uploads only the blocks under the changed parts of the sheet, on every level. False if
+// that isn't enough, because the sheet isn't uploaded compressed or the changes need alpha blocks.
+bool UpdateCompressedSheet(sleveldata_t& leveldata, const std::vector<sheetrect_t>& changed)
+{
+    const level_t& level = leveldata.level;
+    if (leveldata.texid == 0 || leveldata.sheetBlocks.size() != level.sheetMips.size() + 1)
         return false;
+    if (leveldata.sheetFormat == EBlockFormat::BC1)
+        for (const auto& rect : changed)
+            if (ChooseBlockFormat(level.sheet, rect) != EBlockFormat::BC1)
+                return false;
+
+    const size_t blockSize = GetCompressedSize(leveldata.sheetFormat, 4, 4);
+    std::vector<unsigned char> upload;
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, leveldata.texid);
+    for (size_t i = 0; i < leveldata.sheetBlocks.size(); ++i)
+    {
+        const texture_t& image = i == 0 ? level.sheet : level.sheetMips[i - 1];
+        auto& blocks = leveldata.sheetBlocks[i];
+        const int scale = 1 << i;
+        for (const auto& rect : changed)
+        {
+            // The rectangle on this level, grown to whole blocks
+            const sheetrect_t r = {
+                rect.x0 / scale & ~3,
+                rect.y0 / scale & ~3,
+                std::min(((rect.x1 + scale - 1) / scale + 3) & ~3, (int)image.w),
+                std::min(((rect.y1 + scale - 1) / scale + 3) & ~3, (int)image.h)
+            };
+            if (r.x0 >= r.x1 || r.y0 >= r.y1)
+                continue;
+            CompressRect(image, leveldata.sheetFormat, r, blocks.data());
+
+            // Only whole rows of blocks are contiguous, so the rectangle's blocks are gathered first
+            const size_t rowBytes = (r.x1 - r.x0) / 4 * blockSize;
+            upload.resize(rowBytes * ((r.y1 - r.y0) / 4));
+            for (int by = r.y0 / 4; by < r.y1 / 4; ++by)
+                memcpy(&upload[(by - r.y0 / 4) * rowBytes], &blocks[((size_t)by * (image.w / 4) + r.x0 / 4) * blockSize], rowBytes);
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, (GLint)i, r.x0, r.y0, r.x1 - r.x0, r.y1 - r.y0, GetGLFormat(leveldata.sheetFormat), (GLsizei)upload.size(), upload.data());
+        }
     }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return true;
+}
+
+// Not in our glad headers (GL 3.0)
+#ifndef GL_RGBA32F
+#define GL_RGBA32F 0x8814
+#endif
+
+// Rows of the material rectangle table, basic.vert finds slot s at (s % width, s / width)
+constexpr int c_MATERIALRECTWIDTH = 256;
+
+// Uploads the sheet rectangle of every material for basic.vert, which maps the texture-local UVs of
+// the vertices with it. Repacking the sheet only needs this again, never new vertex buffers.
+void UploadMaterialRects(sleveldata_t& leveldata)
+{
+    std::vector<glm::vec4> rects = GetMaterialRects(leveldata.level);
+    const int rows = std::max<int>(1, ((int)rects.size() + c_MATERIALRECTWIDTH - 1) / c_MATERIALRECTWIDTH);
+    rects.resize(rows * c_MATERIALRECTWIDTH, glm::vec4(0, 0, 1, 1));
+
+    if (leveldata.rectid == 0)
+        glGenTextures(1, &leveldata.rectid);
+    glBindTexture(GL_TEXTURE_2D, leveldata.rectid);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, c_MATERIALRECTWIDTH, rows, 0, GL_RGBA, GL_FLOAT, rects.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void UploadTextureSheet(sleveldata_t& leveldata)
+{
+    if (leveldata.texid == 0)
+        glGenTextures(1, &leveldata.texid);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, leveldata.texid);
+    // Mips come from the loader, which keeps them from bleeding across textures in the sheet
+    const auto& mips = leveldata.level.sheetMips;
+    leveldata.sheetBlocks.clear();
+    if (!compressTextures || !UploadCompressedSheet(leveldata))
+    {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, leveldata.level.sheet.w, leveldata.level.sheet.h, 0, GL_RGBA, GL_UNSIGNED_BYTE, leveldata.level.sheet.pixels);
+        for (size_t i = 0; i < mips.size(); ++i)
+            glTexImage2D(GL_TEXTURE_2D, (GLint)i + 1, GL_RGBA8, mips[i].w, mips[i].h, 0, GL_RGBA, GL_UNSIGNED_BYTE, mips[i].pixels);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)mips.size());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mips.empty() ? GL_LINEAR : GL_LINEAR_MIPMAP_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    UploadMaterialRects(leveldata);
+}
+
+// Uploads what a lazy load changed in the sheet. Compressed sheets only get the changed blocks encoded,
+// anything else is simply uploaded again.
+void UpdateTextureSheet(sleveldata_t& leveldata, const std::vector<sheetrect_t>& changed)
+{
+    if (!UpdateCompressedSheet(leveldata, changed))
+        UploadTextureSheet(leveldata);
+}
+
+// Reads a lazily loaded model's geometry and builds its buffer the first time it's needed
+globj_t& GetObj(sleveldata_t& leveldata, size_t index)
+{
+    auto& model = leveldata.level.models[index];
+    if (!mdls[index])
+    {
+        std::vector<sheetrect_t> changed;
+        if (LoadModelGeometry(leveldata.level, model, &changed))
+            UpdateTextureSheet(leveldata, changed);
+        mdls[index] = createobj(leveldata.level, model);
+    }
+    return *mdls[index];
+}
+
+ImVec4 bgColor = { 0xBB / 255.f, 0xF6 / 255.f, 0xF7 / 255.f, 255 };
+
+std::string levelPath, levelName;
+// Called once a background load finished, with the new level already in leveldata
+void FinishOpenLevel(const std::string& levelPath, sleveldata_t& leveldata)
+{
     ::levelPath = levelPath;
     size_t fsi = ::levelPath.find_last_of("/");
     size_t bsi = ::levelPath.find_last_of("\\");
@@ -400,17 +513,81 @@ bool OpenLevel(const char* levelPath, sleveldata_t& leveldata)
     bgColor.z = leveldata.level.bgColor[2];
 
     for (auto& m : leveldata.level.models)
-        mdls.push_back(createobj(m));
+        mdls.push_back(m->geometryPending ? nullptr : createobj(leveldata.level, m));
 
-    glGenTextures(1, &leveldata.texid);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, leveldata.texid);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, leveldata.level.sheet.w, leveldata.level.sheet.h, 0, GL_RGBA, GL_FLOAT, leveldata.level.sheet.pixels);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    UploadTextureSheet(leveldata);
+}
 
-    return true;
+// A level being loaded on a worker thread. The viewer keeps drawing the current level meanwhile and
+// swaps the new one in on the main thread once it's done, since that's where all the GL work happens.
+struct levelload_t
+{
+    std::string path;
+    level_t level;
+    std::atomic<ELoadStage> stage{ ELoadStage::Opening };
+    std::atomic<bool> finished{ false };
+    bool succeeded = false;
+    std::jthread thread; // Last, so it's joined before anything it uses goes away
+};
+
+std::unique_ptr<levelload_t> currentLoad;
+std::vector<std::unique_ptr<levelload_t>> cancelledLoads; // Waiting for their worker to notice
+
+void CancelLevelLoad()
+{
+    if (!currentLoad)
+        return;
+
+    currentLoad->thread.request_stop();
+    cancelledLoads.push_back(std::move(currentLoad));
+}
+
+void StartLevelLoad(const std::string& path)
+{
+    CancelLevelLoad();
+    printf("Loading level \"%s\"\n", path.c_str());
+
+    currentLoad = std::make_unique<levelload_t>();
+    currentLoad->path = path;
+    levelload_t* load = currentLoad.get();
+    load->thread = std::jthread([load, lazy = lazyObjects, lazyTex = lazyTextures](std::stop_token stop)
+        {
+            {
+                LoadTask task = LoadLevelStaged(load->path, load->level, lazy, lazyTex, stop);
+                while (!stop.stop_requested() && task.Resume())
+                    load->stage = task.GetStage();
+
+                load->succeeded = !stop.stop_requested() && task.GetResult();
+            }
+
+            if (!load->succeeded)
+                FreeLevel(load->level);
+            load->finished = true;
+        });
+}
+
+// Picks up a finished load, called once per frame before anything is drawn
+void UpdateLevelLoad(sleveldata_t& leveldata)
+{
+    std::erase_if(cancelledLoads, [](const std::unique_ptr<levelload_t>& load) { return load->finished.load(); });
+
+    if (!currentLoad || !currentLoad->finished)
+        return;
+
+    std::unique_ptr<levelload_t> load = std::move(currentLoad);
+    load->thread.join();
+
+    CloseLevel(leveldata);
+    if (!load->succeeded)
+    {
+        printf("Failed to load level \"%s\"\n", load->path.c_str());
+        ::levelPath = levelName = "";
+        return;
+    }
+
+    // The whole level is replaced at once between two frames, nothing ever sees a partial one
+    std::swap(leveldata.level, load->level);
+    FinishOpenLevel(load->path, leveldata);
 }
 
 bool str_ends_with_nocase(std::string src, std::string trg)
@@ -433,7 +610,7 @@ bool str_ends_with_nocase(std::string src, std::string trg)
 }
 
 void DumpObjects(FILE* f, sleveldata_t& leveldata);
-void ExportModel(FILE* f, std::shared_ptr<Model> mdl);
+void ExportModel(FILE* f, const level_t& level, std::shared_ptr<Model> mdl);
 void ExportTextureSheet(FILE* f, sleveldata_t& leveldata);
 
 int main()
@@ -466,12 +643,12 @@ int main()
     sleveldata_t leveldata;
 
     std::vector<Vertex> vertices = {
-        {{-10, -10, 50}, {0.5f, 0.5f, 0.5f, 0.5f}, {1, 1}},
-        {{10, -10, 50}, {0.5f, 0.5f, 0.5f, 0.5f}, {0, 1}},
-        {{10, 10, 50}, {0.5f, 0.5f, 0.5f, 0.5f}, {0, 0}},
-        {{-10, -10, 50}, {0.5f, 0.5f, 0.5f, 0.5f}, {1, 1}},
-        {{10, 10, 50}, {0.5f, 0.5f, 0.5f, 0.5f}, {0, 0}},
-        {{-10, 10, 50}, {0.5f, 0.5f, 0.5f, 0.5f}, {1, 0}},
+        {{-10, -10, 50}, {0.5f, 0.5f, 0.5f, 0.5f}, {1, 1}, -1},
+        {{10, -10, 50}, {0.5f, 0.5f, 0.5f, 0.5f}, {0, 1}, -1},
+        {{10, 10, 50}, {0.5f, 0.5f, 0.5f, 0.5f}, {0, 0}, -1},
+        {{-10, -10, 50}, {0.5f, 0.5f, 0.5f, 0.5f}, {1, 1}, -1},
+        {{10, 10, 50}, {0.5f, 0.5f, 0.5f, 0.5f}, {0, 0}, -1},
+        {{-10, 10, 50}, {0.5f, 0.5f, 0.5f, 0.5f}, {1, 0}, -1},
     };
 
     bool showTexturePanel = false;
@@ -482,6 +659,7 @@ int main()
     while(!glfwWindowShouldClose(g_Window))
     {
         glfwPollEvents();
+        UpdateLevelLoad(leveldata);
         int width, height;
         glfwGetFramebufferSize(g_Window, &width, &height);
         glViewport(0, 0, width, height);
@@ -525,7 +703,7 @@ int main()
                 for (auto& inst : leveldata.level.models[i]->instances)
                 {
                     if (inst.isVisible)
-                        mdls[i]->draw(program, leveldata, inst, leveldata.level.models[i]->name);
+                        GetObj(leveldata, i).draw(program, leveldata, inst, leveldata.level.models[i]->name);
                 }
             if (noObjects)
                 break;
@@ -548,6 +726,10 @@ int main()
             ImGui::Text("Stats:");
             ImGui::Text("  Polygons: %d", leveldata.level.models.empty() ? 0 : leveldata.level.models[0]->polygons.size());
             ImGui::Text("  Textures: %d", leveldata.level.textures.size() - 1);
+            ImGui::Text("  Referenced: %d", (int)std::count_if(leveldata.level.textures.begin(), leveldata.level.textures.end(), [](const texture_t& t) { return t.referenced; }));
+            ImGui::Text("  Cutout: %d, Translucent: %d",
+                (int)std::count_if(leveldata.level.textures.begin(), leveldata.level.textures.end(), [](const texture_t& t) { return t.decoded && t.alpha == ETextureAlpha::Cutout; }),
+                (int)std::count_if(leveldata.level.textures.begin(), leveldata.level.textures.end(), [](const texture_t& t) { return t.decoded && t.alpha == ETextureAlpha::Translucent; }));
             ImGui::Spacing();
             ImGui::Separator();
             ImGui::Spacing();
@@ -573,11 +755,29 @@ int main()
             ImGui::Checkbox("Toggle Textures?", &texturesVis);
             ImGui::Checkbox("Toggle Objects?", &noObjects);
             ImGui::Checkbox("Toggle Billboarding?", &enableBillboarding);
+            ImGui::Checkbox("Load Objects On Demand?", &lazyObjects);
+            if (ImGui::IsItemHovered())
+                ImGui::SetTooltip("Object geometry is read when first shown or exported.\nApplies to the next opened level.");
+            ImGui::Checkbox("Load Textures On Demand?", &lazyTextures);
+            if (ImGui::IsItemHovered())
+                ImGui::SetTooltip("Textures are decoded when something first uses them.\nApplies to the next opened level.");
+            if (ImGui::Checkbox("Compress Textures?", &compressTextures) && leveldata.texid != 0)
+                UploadTextureSheet(leveldata);
+            if (ImGui::IsItemHovered())
+                ImGui::SetTooltip("Uploads the texture sheet as BC1/BC3 blocks to save video memory.");
             if (ImGui_CenteredButton("Open Level (*.dfx)"))
             {
                 auto path = OpenLoadPrompt("Gex 3D Level File (*.dfx)\0*.dfx\0All files (*.*)\0*.*\0");
                 if (!path.empty())
-                    OpenLevel(path.c_str(), leveldata);
+                    StartLevelLoad(path);
+            }
+
+            if (currentLoad)
+            {
+                const ELoadStage stage = currentLoad->stage;
+                ImGui::ProgressBar((int)stage / (float)ELoadStage::Done, { -1, 0 }, GetLoadStageName(stage));
+                if (ImGui_CenteredButton("Cancel Loading"))
+                    CancelLevelLoad();
             }
 
             if (ImGui_CenteredButton("Open Objects Panel"))
@@ -641,8 +841,9 @@ int main()
                                     for (int i = 0; i < 3; ++i)
                                     {
                                         const auto& vert = v[p.vertex[i]];
+                                        const glm::vec2 uv = GetAtlasUV(leveldata.level, p.materialID, p.uvs[i]);
 
-                                        vertices.push_back({ vert.x / -1000.f, vert.z / 1000.f, vert.y / 1000.f, vert.r, vert.g, vert.b, p.uvs[i][0],  1.f - p.uvs[i][1] });
+                                        vertices.push_back({ vert.x / -1000.f, vert.z / 1000.f, vert.y / 1000.f, vert.r, vert.g, vert.b, uv.x,  1.f - uv.y });
                                     }
                                 }
                             }
@@ -707,6 +908,10 @@ int main()
             ImGui::SetNextWindowPos({ ImGui::GetWindowWidth() / 2.f, ImGui::GetWindowHeight() / 2.f }, ImGuiCond_Appearing);
             if (ImGui::Begin("Texture Atlas", &showTexturePanel, ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_AlwaysVerticalScrollbar | ImGuiWindowFlags_AlwaysHorizontalScrollbar))
             {
+                // The whole sheet is on show here, so textures nothing has used yet are needed too
+                if (LoadAllTextures(leveldata.level))
+                    UploadTextureSheet(leveldata);
+
                 ImGui::Text("Atlas Size: %lux%lu", leveldata.level.sheet.w, leveldata.level.sheet.h);
                 ImGui::SameLine();
                 if (ImGui::Button("Export Texture Atlas..."))
@@ -850,10 +1055,14 @@ int main()
                                 if (!str_ends_with_nocase(path, ".ply"))
                                     path += ".ply";
 
+                                std::vector<sheetrect_t> changed;
+                                if (LoadModelGeometry(leveldata.level, mdl, &changed))
+                                    UpdateTextureSheet(leveldata, changed);
+
                                 FILE* f = NULL;
                                 fopen_s(&f, path.c_str(), "w");
                                 if (f)
-                                    ExportModel(f, mdl);
+                                    ExportModel(f, leveldata.level, mdl);
 
                             }
                         }
@@ -912,6 +1121,10 @@ int main()
         cameraInvalidated = true;
     }
 
+    // Stop any load still running while the thread pool it uses is still around
+    CancelLevelLoad();
+    cancelledLoads.clear();
+
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
@@ -984,7 +1197,7 @@ void DumpObjects(FILE* f, sleveldata_t& leveldata)
     fclose(f);
 }
 
-void ExportModel(FILE* f, std::shared_ptr<Model> mdl)
+void ExportModel(FILE* f, const level_t& level, std::shared_ptr<Model> mdl)
 {
     auto writeln = [f](const std::string& s)
         {
@@ -1009,8 +1222,9 @@ void ExportModel(FILE* f, std::shared_ptr<Model> mdl)
         for (int i = 0; i < 3; ++i)
         {
             const auto& vert = v[p.vertex[i]];
+            const glm::vec2 uv = GetAtlasUV(level, p.materialID, p.uvs[i]);
 
-            vertices.push_back({ vert.x / -1000.f, vert.z / 1000.f, vert.y / 1000.f, vert.r, vert.g, vert.b, p.uvs[i][0],  1.f - p.uvs[i][1] });
+            vertices.push_back({ vert.x / -1000.f, vert.z / 1000.f, vert.y / 1000.f, vert.r, vert.g, vert.b, uv.x,  1.f - uv.y });
         }
     }
 
@@ -1048,6 +1262,9 @@ void ExportModel(FILE* f, std::shared_ptr<Model> mdl)
 
 void ExportTextureSheet(FILE* f, sleveldata_t& leveldata)
 {
+    if (LoadAllTextures(leveldata.level))
+        UploadTextureSheet(leveldata);
+
     unsigned char tga[18];
     memset(tga, 0, 18);
     tga[2] = 2;
@@ -1063,12 +1280,8 @@ void ExportTextureSheet(FILE* f, sleveldata_t& leveldata)
     for (unsigned int y = 0; y < leveldata.level.sheet.h; ++y)
         for (unsigned int x = 0; x < leveldata.level.sheet.w; ++x)
         {
-            pixel = {
-                (byte)(leveldata.level.sheet.pixels[y * leveldata.level.sheet.w + x][2] * 255),
-                (byte)(leveldata.level.sheet.pixels[y * leveldata.level.sheet.w + x][1] * 255),
-                (byte)(leveldata.level.sheet.pixels[y * leveldata.level.sheet.w + x][0] * 255),
-                (byte)(leveldata.level.sheet.pixels[y * leveldata.level.sheet.w + x][3] * 255),
-            };
+            const rgba8_t& texel = leveldata.level.sheet.pixels[y * leveldata.level.sheet.w + x];
+            pixel = { texel.b, texel.g, texel.r, texel.a };
             fwrite(&pixel, sizeof(_pixel), 1, f);
         }
 
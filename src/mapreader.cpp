@@ -1,127 +1,21 @@
 #include "mapreader.h"
 #include "glideconstants.h"
+#include "dfxrecords.h"
+#include "vertexdecode.h"
+#include "texeldecode.h"
+#include "atlascache.h"
+#include "objectregistry.h"
+#include "threadpool.h"
 #include <bit>
 #include <glm/glm.hpp>
 #include <glm/ext/scalar_constants.hpp> // glm::pi
 #include <unordered_map>
 #include <algorithm>
+#include <numeric>
 
 #include <imgui/imgui.h>
 #include <set>
 
-struct file_t
-{
-	using data_t = unsigned char;
-	data_t* data;
-	size_t size;
-	size_t baseOffset = 0;
-
-	template<typename T>
-	T Read(size_t offset, bool moveOffset = false)
-	{
-		T data = _Read<T>(baseOffset + offset + _getoffset());
-		if constexpr (std::endian::native == std::endian::big && sizeof(T) > 1)
-		{
-			using byte = unsigned char;
-			for (int i = 0; i < sizeof(T) >> 1; ++i)
-			{
-				static_cast<byte*>(&data)[i] ^= static_cast<byte*>(&data)[sizeof(T) - i - 1];
-				static_cast<byte*>(&data)[sizeof(T) - i - 1] ^= static_cast<byte*>(&data)[i];
-				static_cast<byte*>(&data)[i] ^= static_cast<byte*>(&data)[sizeof(T) - i - 1];
-			}
-		}
-
-		if (moveOffset)
-			offsets.back() += sizeof(T) + offset;
-
-		return data;
-	}
-
-	// Like Read, but ignores local offset, and thus also can't move the offset
-	// For whenever you only really need to read one value from base
-	template<typename T>
-	T ReadAt(size_t offset)
-	{
-		T data = _Read<T>(baseOffset + offset);
-		if constexpr (std::endian::native == std::endian::big && sizeof(T) > 1)
-		{
-			using byte = unsigned char;
-			for (int i = 0; i < sizeof(T) >> 1; ++i)
-			{
-				static_cast<byte*>(&data)[i] ^= static_cast<byte*>(&data)[sizeof(T) - i - 1];
-				static_cast<byte*>(&data)[sizeof(T) - i - 1] ^= static_cast<byte*>(&data)[i];
-				static_cast<byte*>(&data)[i] ^= static_cast<byte*>(&data)[sizeof(T) - i - 1];
-			}
-		}
-
-		return data;
-	}
-
-	void seek(size_t offset, bool replace = false)
-	{
-		if (replace)
-		{
-			if (offsets.empty())
-				offsets.push_back(0);
-			offsets.back() = offset;
-		}
-		else
-			offsets.push_back(offset);
-	}
-
-	void pop()
-	{
-		if (!offsets.empty())
-			offsets.pop_back();
-	}
-
-	template<typename T = data_t>
-	T* ptr() { return (T*)(data + baseOffset + _getoffset()); }
-
-	// like ptr, but without a local offset
-	template<typename T = data_t>
-	T* ptrAt(size_t offset) { return (T*)(data + baseOffset + offset); }
-
-	void Close()
-	{
-		delete[] data;
-		data = nullptr;
-		size = 0;
-		baseOffset = 0;
-		offsets.clear();
-	}
-
-	~file_t()
-	{
-		Close();
-	}
-
-	size_t _getoffset()
-	{
-		if (offsets.empty())
-			offsets.push_back(0);
-
-		return offsets.back();
-	}
-	
-private:
-
-
-	template<typename T>
-	T _Read(size_t offset)
-	{
-#ifdef DEBUG
-		if (offset >= size)
-		{
-			printf("READ OUT OF BOUNDS! %x >= %x!\n", offset, size);
-		}
-#endif
-		return *(T*)(data + offset);
-	}
-
-	std::vector<size_t> offsets;
-};
-
 void CreateCube(std::shared_ptr<Model> model)
 {
 	model->vertices.push_back({ -100, -100, -100,-100, -100, -100, 0, 128, 128, 128, 255 });
@@ -146,7 +40,8 @@ void CreateCube(std::shared_ptr<Model> model)
 	model->polygons.push_back({ {0, 5, 4}, 0, 0, {{0, 0}, {1, 1}, {0, 1}} });
 }
 
-static std::vector<texture_t> customImages;
+// Sprite images for the helper objects, decoded once and shared read-only by every load
+const std::vector<texture_t>& GetCustomImages();
 
 namespace ECustomImageType
 {
@@ -174,6 +69,14 @@ ImagePacker::ImageInformation_t* FindImageInfoById(ImagePacker::ImageInformation
 	return nullptr;
 }
 
+// Sheet rectangle of a texture or custom image, textures sharing another one's contents resolve to its rectangle
+ImagePacker::ImageInformation_t* FindTextureRect(level_t& level, unsigned int id)
+{
+	if (id < level.textures.size() && level.textures[id].sharesWith >= 0)
+		id = level.textures[id].sharesWith;
+	return FindImageInfoById(level.list, id);
+}
+
 void CreateSpriteObject(level_t& level, std::shared_ptr<Model> model, const std::string& name, unsigned int customId, int scale = 5)
 {
 	model->name = name;
@@ -207,34 +110,21 @@ void CreateSpriteObject(level_t& level, std::shared_ptr<Model> model, const std:
 	//}
 }
 
-bool ReadFile(const std::string& filepath, file_t& file)
+// Decoded material record, shared by every polygon that points at the same address
+struct material_t
 {
-	FILE* f = NULL;
-	fopen_s(&f, filepath.c_str(), "rb");
-	if (f)
-	{
-		fseek(f, 0, SEEK_END);
-		file.size = ftell(f);
-		fseek(f, 0, SEEK_SET);
-		file.data = new file_t::data_t[file.size];
-		fread(file.data, file.size, 1, f);
-		fclose(f);
-		return true;
-	}
-
-	file.data = NULL;
-	return false;
-}
-
-using byte = unsigned char;
-using u16 = unsigned short;
-using u32 = unsigned int;
-using i16 = signed short;
-using i32 = signed int;
-using addr_t = u32;
+	glm::vec2 uvs[3];
+	unsigned int textureId;
+	byte flags;
+	bool valid;
+	bool alphaFixQueued; // Texture already added to levelext_t::materialsToFix
+};
 
 struct levelext_t
 {
+	std::unordered_map<addr_t, material_t> materials;
+	std::unordered_map<addr_t, u32> modelIndices; // Model address -> index into level.models, only while ReadLevel reads the instances
+	std::set<unsigned int> materialsToFix; // Textures of materials asking for transparent black, see MarkCutouts
 	addr_t modelAddress;
 	u32 nObjects;
 	addr_t objAddress;
@@ -243,6 +133,50 @@ struct levelext_t
 	float skyboxRGB[3];
 };
 
+struct GexTex_t
+{
+	struct TexInfo_t
+	{
+		GrLOD_t smallLod;
+		GrLOD_t largeLod;
+		GrAspectRatio_t aspectRatio;
+		GrTextureFormat_t format;
+	} info;
+	struct NCCTable_t
+	{
+		FxU8 yRGB[16];
+		FxI16 iRGB[4][3];
+		FxI16 qRGB[4][3];
+		FxU32 packed_data[12];
+	} ncctable;
+	FxU32 smallLodBytes;
+	FxU32 largeLodBytes;
+};
+
+// A texture in the VFX as found by IndexVFX, so nothing needs to walk the file again
+struct vfxentry_t
+{
+	GexTex_t tex;
+	size_t texelOffset; // Start of the largest LOD's texels in the VFX
+	u32 w, h;
+	int sharesWith = -1; // Earlier entry that decodes to the exact same image, -1 if there's none
+};
+
+// All state of a single LoadLevel call, so several levels can be loaded at the same time.
+// The level keeps it alive in lazy mode so deferred model geometry can still be read.
+struct LoaderContext
+{
+	file_t dfx;
+	levelext_t levelData;
+	const std::vector<texture_t>& customImages = GetCustomImages();
+
+	// Only touched by the texture pipeline
+	file_t vfx;
+	std::vector<vfxentry_t> vfxIndex;
+	uint64_t atlasKey = 0;
+	bool atlasCached = false; // The sheet came from the cache or has been written to it
+};
+
 struct geo_t
 {
 	bool isLevel;
@@ -262,196 +196,225 @@ struct geo_t
 
 void ReadVertices(file_t& dfx, level_t& level, levelext_t& levelData, geo_t& geo, std::shared_ptr<Model> model)
 {
-	dfx.seek(geo.vertexAddress);
-	for (u32 i = 0; i < geo.vertexCount; ++i)
+	const cursor_t table = DFX::VertexRecord::Table(dfx, geo.vertexAddress, geo.vertexCount);
+	if (!table)
 	{
-		model->vertices.push_back(
-			{
-				dfx.Read<i16>(i * 12 + 0), dfx.Read<i16>(i * 12 + 4), (short)-dfx.Read<i16>(i * 12 + 2),
-				dfx.Read<i16>(i * 12 + 0), dfx.Read<i16>(i * 12 + 4), (short)-dfx.Read<i16>(i * 12 + 2),
-				dfx.Read<u16>(i * 12 + 6),
-				dfx.Read<byte>(i * 12 + 8), dfx.Read<byte>(i * 12 + 9), dfx.Read<byte>(i * 12 + 10), dfx.Read<byte>(i * 12 + 11)
-			});
+		printf("Vertex table at %x is out of bounds!\n", geo.vertexAddress);
+		return;
+	}
 
-		if (!geo.isLevel)
+	// Decoded straight into the vertex array instead of growing it one vertex at a time
+	const size_t first = model->vertices.size();
+	model->vertices.resize(first + geo.vertexCount);
+	DecodeVertices(table.data, geo.vertexCount, model->vertices.data() + first, geo.isLevel);
+}
+
+// Looks up the material record at materialAddr, decoding it on first use. With queueAlphaFix the texture
+// is added to levelData.materialsToFix if the material asks for it (flags & 2), once per material.
+const material_t& GetMaterial(file_t& dfx, levelext_t& levelData, addr_t materialAddr, bool queueAlphaFix)
+{
+	auto [it, inserted] = levelData.materials.try_emplace(materialAddr);
+	material_t& material = it->second;
+	if (inserted)
+	{
+		const cursor_t mat = DFX::MaterialRecord::Table(dfx, materialAddr, 1);
+		if (mat)
+		{
+			auto [u0, v0, matFlags, u1, v1, textureId, u2, v2] = DFX::MaterialRecord::Unpack(mat, 0);
+			material.uvs[0] = { u0 / 255.f, v0 / 255.f };
+			material.uvs[1] = { u1 / 255.f, v1 / 255.f };
+			material.uvs[2] = { u2 / 255.f, v2 / 255.f };
+			material.textureId = textureId % 0x1000;
+			material.flags = matFlags;
+			material.valid = true;
+		}
+		else
 		{
-			model->vertices.back().r = 128;
-			model->vertices.back().g = 128;
-			model->vertices.back().b = 128;
-			model->vertices.back().a = 255;
+			material.uvs[0] = material.uvs[1] = material.uvs[2] = { 0, 0 };
+			material.textureId = 0xFFFFFFFF;
+			material.flags = 0;
+			material.valid = false;
 		}
+		material.alphaFixQueued = false;
+	}
+
+	// The skybox reads its materials without queueing, so this isn't always the first lookup
+	if (queueAlphaFix && material.valid && (material.flags & 2) && !material.alphaFixQueued)
+	{
+		levelData.materialsToFix.insert(material.textureId);
+		material.alphaFixQueued = true;
 	}
-	dfx.pop();
+	return material;
 }
 
-std::set<unsigned int> materialsToFix;
+// Fills in the polygon's UVs and texture ID from the (cached) material record at materialAddr.
+// Out of bounds records leave the polygon untextured. See GetMaterial for queueAlphaFix.
+void ReadMaterial(file_t& dfx, levelext_t& levelData, addr_t materialAddr, Model::polygon_t& polygon, bool queueAlphaFix)
+{
+	const material_t& material = GetMaterial(dfx, levelData, materialAddr, queueAlphaFix);
+	polygon.uvs[0] = material.uvs[0];
+	polygon.uvs[1] = material.uvs[1];
+	polygon.uvs[2] = material.uvs[2];
+	polygon.materialID = material.textureId;
+}
 
 void ReadPolygons(file_t& dfx, level_t& level, levelext_t& levelData, geo_t& geo, std::shared_ptr<Model> model)
 {
-	dfx.seek(geo.polygonAddress);
 	bool hasTexturedFace = geo.isLevel;
-	for (u32 i = 0; i < geo.polygonCount; ++i)
+	if (geo.isLevel)
 	{
-		Model::polygon_t polygon;
-		const byte stride = geo.isLevel ? 0x14 : 0x0C;
-		polygon.vertex[0] = dfx.Read<u16>(stride * i + 0);
-		polygon.vertex[1] = dfx.Read<u16>(stride * i + 2);
-		polygon.vertex[2] = dfx.Read<u16>(stride * i + 4);
-		polygon.flags = dfx.Read<byte>(stride * i + 7);
-
-		if (geo.isLevel)
+		const cursor_t table = DFX::LevelPolygonRecord::Table(dfx, geo.polygonAddress, geo.polygonCount);
+		if (!table)
 		{
-			addr_t materialAddr = dfx.Read<addr_t>(stride * i + 0x10);
-			if (materialAddr != 0xFFFF && (polygon.flags & 0x80) != 0x80)
-			{
-				dfx.seek(materialAddr);
-				polygon.uvs[0] = { dfx.Read<byte>(0) / 255.f, dfx.Read<byte>(1) / 255.f };
-				polygon.uvs[1] = { dfx.Read<byte>(4) / 255.f, dfx.Read<byte>(5) / 255.f };
-				polygon.uvs[2] = { dfx.Read<byte>(8) / 255.f, dfx.Read<byte>(9) / 255.f };
-				polygon.materialID = dfx.Read<u16>(6) % 0x1000;
-				if ((dfx.Read<byte>(2) & 2))
-					materialsToFix.insert(polygon.materialID);
-				dfx.pop();
-			}
-			else
-			{
-				polygon.uvs[0].x = polygon.uvs[0].y = 0;
-				polygon.uvs[1].x = polygon.uvs[1].y = 0;
-				polygon.uvs[2].x = polygon.uvs[2].y = 0;
-				polygon.materialID = 0xFFFFFFFF;
-			}
+			printf("Polygon table at %x is out of bounds!\n", geo.polygonAddress);
+			return;
 		}
-		else
-		{
-			if ((polygon.flags & 0x02) == 0x02)
+
+		DFX::LevelPolygonRecord::ForEach(table, geo.polygonCount, [&](size_t, u16 v0, u16 v1, u16 v2, byte flags, addr_t materialAddr)
 			{
-				hasTexturedFace = true;
-				addr_t materialAddr = dfx.Read<addr_t>(stride * i + 8);
-				dfx.seek(materialAddr);
-				//polygon.materialID = dfx.Read<u16>(6) % 0x1000;
-				//if (model->name == "charger_" || model->name == "batt____" || model->name == "launch__")
-				//{
-				//	printf("MAT: %d, FLG: %x\n", polygon.materialID, polygon.flags);
-				//}
-				
-				//polygon.materialID = dfx.Read<u16>(6) % 0x1000;
-				//if (geo.textureAnimAddress != 0 && (polygon.flags & 0x8))
-				//{
-				//	dfx.seek(geo.textureAnimAddress);
-				//	dfx.seek(dfx.Read<addr_t>(4), true);
-				//	polygon.materialID = dfx.Read<u16>(6) % 0x1000;
-				//	//polygon.uvs[0] = { dfx.Read<byte>(0) / 255.f, dfx.Read<byte>(1) / 255.f };
-				//	//polygon.uvs[1] = { dfx.Read<byte>(4) / 255.f, dfx.Read<byte>(5) / 255.f };
-				//	//polygon.uvs[2] = { dfx.Read<byte>(8) / 255.f, dfx.Read<byte>(9) / 255.f };
-				//	dfx.pop();
-				//}
-				//else
+				Model::polygon_t polygon;
+				polygon.vertex[0] = v0;
+				polygon.vertex[1] = v1;
+				polygon.vertex[2] = v2;
+				polygon.flags = flags;
+
+				if (materialAddr != 0xFFFF && (polygon.flags & 0x80) != 0x80)
 				{
-					polygon.materialID = dfx.Read<u16>(6) % 0x1000;
+					ReadMaterial(dfx, levelData, materialAddr, polygon, true);
 				}
+				else
+				{
+					polygon.uvs[0].x = polygon.uvs[0].y = 0;
+					polygon.uvs[1].x = polygon.uvs[1].y = 0;
+					polygon.uvs[2].x = polygon.uvs[2].y = 0;
+					polygon.materialID = 0xFFFFFFFF;
+				}
+				model->polygons.push_back(polygon);
+			});
+	}
+	else
+	{
+		const cursor_t table = DFX::ObjectPolygonRecord::Table(dfx, geo.polygonAddress, geo.polygonCount);
+		if (!table)
+		{
+			printf("Polygon table at %x is out of bounds!\n", geo.polygonAddress);
+			return;
+		}
 
-				polygon.uvs[0] = { dfx.Read<byte>(0) / 255.f, dfx.Read<byte>(1) / 255.f };
-				polygon.uvs[1] = { dfx.Read<byte>(4) / 255.f, dfx.Read<byte>(5) / 255.f };
-				polygon.uvs[2] = { dfx.Read<byte>(8) / 255.f, dfx.Read<byte>(9) / 255.f };
-				if ((dfx.Read<byte>(2) & 2))
-					materialsToFix.insert(polygon.materialID);
-				
-				dfx.pop();
-			}
-			else
+		DFX::ObjectPolygonRecord::ForEach(table, geo.polygonCount, [&](size_t, u16 v0, u16 v1, u16 v2, byte flags, u32 extra)
 			{
-				polygon.materialID = 0xFFFFFFFF;
-				for (int j = 0; j < 4; ++j)
+				Model::polygon_t polygon;
+				polygon.vertex[0] = v0;
+				polygon.vertex[1] = v1;
+				polygon.vertex[2] = v2;
+				polygon.flags = flags;
+
+				if ((polygon.flags & 0x02) == 0x02)
 				{
-					polygon.optColors[j] = dfx.Read<byte>(8 + j);
+					hasTexturedFace = true;
+					//polygon.materialID = dfx.Read<u16>(6) % 0x1000;
+					//if (model->name == "charger_" || model->name == "batt____" || model->name == "launch__")
+					//{
+					//	printf("MAT: %d, FLG: %x\n", polygon.materialID, polygon.flags);
+					//}
+
+					//polygon.materialID = dfx.Read<u16>(6) % 0x1000;
+					//if (geo.textureAnimAddress != 0 && (polygon.flags & 0x8))
+					//{
+					//	dfx.seek(geo.textureAnimAddress);
+					//	dfx.seek(dfx.Read<addr_t>(4), true);
+					//	polygon.materialID = dfx.Read<u16>(6) % 0x1000;
+					//	//polygon.uvs[0] = { dfx.Read<byte>(0) / 255.f, dfx.Read<byte>(1) / 255.f };
+					//	//polygon.uvs[1] = { dfx.Read<byte>(4) / 255.f, dfx.Read<byte>(5) / 255.f };
+					//	//polygon.uvs[2] = { dfx.Read<byte>(8) / 255.f, dfx.Read<byte>(9) / 255.f };
+					//	dfx.pop();
+					//}
+					//else
+					ReadMaterial(dfx, levelData, extra, polygon, true);
 				}
-			}
-		}
-		model->polygons.push_back(polygon);
+				else
+				{
+					polygon.materialID = 0xFFFFFFFF;
+					for (int j = 0; j < 4; ++j)
+					{
+						polygon.optColors[j] = (extra >> (8 * j)) & 0xFF;
+					}
+				}
+				model->polygons.push_back(polygon);
+			});
 	}
 	model->hasNoTextures = !hasTexturedFace;
-	dfx.pop();
 }
 
 void ReadSkybox(file_t& dfx, level_t& level, levelext_t& levelData, geo_t& geo, std::shared_ptr<Model> model)
 {
-	dfx.seek(levelData.skyboxAddress);
-
 	model->name = "@Skybox";
 	model->instances.push_back({ {0, 0, 0}, {0, 0, 0} });
 
-	for (u32 i = 0; i < levelData.nSkybox; ++i)
+	const cursor_t headers = DFX::SkyboxRecord::Table(dfx, levelData.skyboxAddress, levelData.nSkybox);
+	if (!headers)
 	{
-		u32 vertexOffset = model->vertices.size();
-		u16 nPoly = dfx.Read<u16>(2, true);
-		addr_t vertAddr = dfx.Read<addr_t>(0, true);
-		addr_t polyAddr = dfx.Read<addr_t>(0, true);
-		u32 nVerts = dfx.Read<u32>(8, true);
-
-		dfx.seek(vertAddr);
-		for (u32 v = 0; v < nVerts; ++v)
-		{
-			int x = (short)(dfx.Read<i16>(0, true)) * 20;
-			int y = (short)(dfx.Read<i16>(0, true)) * 20;
-			int z = (short)(dfx.Read<i16>(0, true)) * 20;
-			u16 n = dfx.Read<u16>(0, true);
-			model->vertices.push_back(Model::vertex_t{ x, z, -y, x, z, -y, n, 128, 128, 128, 255 });
-		}
+		printf("Skybox table at %x is out of bounds!\n", levelData.skyboxAddress);
+		return;
+	}
 
-		dfx.seek(polyAddr, true);
-		for (u32 p = 0; p < nPoly; ++p)
+	DFX::SkyboxRecord::ForEach(headers, levelData.nSkybox, [&](size_t i, u16 nPoly, addr_t vertAddr, addr_t polyAddr, u32 nVerts)
 		{
-			Model::polygon_t poly;
-			poly.vertex[0] = dfx.Read<u16>(0, true) + vertexOffset;
-			poly.vertex[1] = dfx.Read<u16>(0, true) + vertexOffset;
-			poly.vertex[2] = dfx.Read<u16>(0, true) + vertexOffset;
-			poly.flags = dfx.Read<u16>(0, true) + vertexOffset;
-
-			addr_t materialAddress = dfx.Read<addr_t>(0, true);
-			u32 tempOffset = dfx.baseOffset;
-			dfx.seek(materialAddress);
-			poly.uvs[0].x = dfx.Read<byte>(0, true) / 255.f;
-			poly.uvs[0].y = dfx.Read<byte>(0, true) / 255.f;
-			poly.uvs[1].x = dfx.Read<byte>(2, true) / 255.f;
-			poly.uvs[1].y = dfx.Read<byte>(0, true) / 255.f;
-			poly.materialID = dfx.Read<u16>(0, true) % 0x1000;
-			poly.uvs[2].x = dfx.Read<byte>(0, true) / 255.f;
-			poly.uvs[2].y = dfx.Read<byte>(0, true) / 255.f;
-			dfx.pop();
-
-			//if (auto info = FindImageInfoById(level.list, poly.materialID))
-			//{
-			//	for (int j = 0; j < 3; ++j)
-			//	{
-			//		poly.uvs[j].x *= info->width;
-			//		poly.uvs[j].y *= info->height;
-			//		poly.uvs[j].x += info->x;
-			//		poly.uvs[j].y += info->y;
-			//		poly.uvs[j].x /= (float)level.sheet.w;
-			//		poly.uvs[j].y /= (float)level.sheet.h;
-			//	}
-			//}
-
-			model->polygons.push_back(poly);
-		}
-		dfx.pop();
-	}
-	dfx.pop();
+			u32 vertexOffset = model->vertices.size();
+
+			const cursor_t verts = DFX::SkyboxVertexRecord::Table(dfx, vertAddr, nVerts);
+			const cursor_t polys = DFX::SkyboxPolygonRecord::Table(dfx, polyAddr, nPoly);
+			if (!verts || !polys)
+			{
+				printf("Skybox part %zu is out of bounds!\n", i);
+				return;
+			}
+
+			model->vertices.resize(vertexOffset + nVerts);
+			DecodeSkyboxVertices(verts.data, nVerts, model->vertices.data() + vertexOffset);
+
+			DFX::SkyboxPolygonRecord::ForEach(polys, nPoly, [&](size_t, u16 v0, u16 v1, u16 v2, u16 flags, addr_t materialAddress)
+				{
+					Model::polygon_t poly;
+					poly.vertex[0] = v0 + vertexOffset;
+					poly.vertex[1] = v1 + vertexOffset;
+					poly.vertex[2] = v2 + vertexOffset;
+					poly.flags = flags + vertexOffset;
+
+					ReadMaterial(dfx, levelData, materialAddress, poly, false);
+
+					//if (auto info = FindImageInfoById(level.list, poly.materialID))
+					//{
+					//	for (int j = 0; j < 3; ++j)
+					//	{
+					//		poly.uvs[j].x *= info->width;
+					//		poly.uvs[j].y *= info->height;
+					//		poly.uvs[j].x += info->x;
+					//		poly.uvs[j].y += info->y;
+					//		poly.uvs[j].x /= (float)level.sheet.w;
+					//		poly.uvs[j].y /= (float)level.sheet.h;
+					//	}
+					//}
+
+					model->polygons.push_back(poly);
+				});
+		});
 }
 
-void ReadLevelGeometry(file_t& dfx, level_t& level, levelext_t& levelData, addr_t geometryAddress)
+bool ReadLevelGeometry(file_t& dfx, level_t& level, levelext_t& levelData, addr_t geometryAddress)
 {
-	dfx.seek(geometryAddress);
+	const cursor_t header = DFX::LevelGeometryRecord::Table(dfx, geometryAddress, 1);
+	if (!header)
+	{
+		printf("Level geometry at %x is out of bounds!\n", geometryAddress);
+		return false;
+	}
+
 	geo_t geo;
 	geo.isLevel = true;
-	geo.bspAddress = dfx.Read<addr_t>(0);
-	geo.vertexCount = dfx.Read<u32>(0x18);
-	geo.polygonCount = dfx.Read<u32>(0x1C);
-	geo.vertexColorCount = dfx.Read<u32>(0x20);
-	geo.vertexAddress = dfx.Read<addr_t>(0x24);
-	geo.polygonAddress = dfx.Read<addr_t>(0x28);
-	geo.vertexColorAddress = dfx.Read<addr_t>(0x2C);
-	geo.materialAddress = dfx.Read<addr_t>(0x30);
+	std::tie(geo.bspAddress,
+		geo.vertexCount, geo.polygonCount, geo.vertexColorCount,
+		geo.vertexAddress, geo.polygonAddress, geo.vertexColorAddress, geo.materialAddress) = DFX::LevelGeometryRecord::Unpack(header, 0);
 	level.models.push_back(std::make_shared<Model>(0xFFFF'FFFF));
 	level.models.back()->name = "@Level";
 
@@ -462,17 +425,52 @@ void ReadLevelGeometry(file_t& dfx, level_t& level, levelext_t& levelData, addr_
 	ReadSkybox(dfx, level, levelData, geo, skybox);
 	level.models.push_back(skybox);
 
-	dfx.pop();
+	return true;
+}
+
+void ReadObjectParts(file_t& dfx, level_t& level, levelext_t& levelData, std::shared_ptr<Model> model, u16 objCount, addr_t objStartAddr)
+{
+	const cursor_t objTable = dfx.At(objStartAddr, (size_t)objCount * 4);
+	if (!objTable)
+	{
+		printf("Model %s has a bad object table!\n", model->name.c_str());
+		return;
+	}
+
+	for (u16 i = 0; i < objCount; ++i)
+	{
+		const cursor_t obj = DFX::ObjectRecord::Table(dfx, objTable.Read<addr_t>(i * 4), 1);
+		if (!obj)
+			continue;
+
+		geo_t geo;
+		geo.isLevel = false;
+		std::tie(geo.vertexCount, geo.vertexAddress,
+			geo.polygonCount, geo.polygonAddress,
+			geo.boneCount, geo.boneAddress,
+			geo.textureAnimAddress) = DFX::ObjectRecord::Unpack(obj, 0);
+
+		ReadVertices(dfx, level, levelData, geo, model);
+		ReadPolygons(dfx, level, levelData, geo, model);
+	}
 }
 
 void ReadObjectGeometry(file_t& dfx, level_t& level, levelext_t& levelData, addr_t modelAddr)
 {
-	dfx.seek(modelAddr);
 	auto model = std::make_shared<Model>(modelAddr);
 	level.models.push_back(model);
-	addr_t modelNameAddr = dfx.Read<addr_t>(0x24);
+
+	const cursor_t header = DFX::ModelRecord::Table(dfx, modelAddr, 1);
+	if (!header)
+	{
+		printf("Model at %x is out of bounds!\n", modelAddr);
+		return;
+	}
+
+	const addr_t modelNameAddr = std::get<2>(DFX::ModelRecord::Unpack(header, 0));
 	char name[9] = { 0 };
-	memcpy(name, dfx.ptrAt<byte>(modelNameAddr), 8);
+	if (const cursor_t nameStr = dfx.At(modelNameAddr, 8))
+		memcpy(name, nameStr.ptr(), 8);
 	printf("Reading %s model data...\n", name);
 	model->name = name;
 
@@ -486,30 +484,21 @@ void ReadObjectGeometry(file_t& dfx, level_t& level, levelext_t& levelData, addr
 		return;
 	}
 
-	u16 objCount = dfx.Read<u16>(8);
-	addr_t objStartAddr = dfx.Read<u32>(12);
-
-	for (u16 i = 0; i < objCount; ++i)
-	{
-		dfx.seek(0, true);
-		dfx.seek(dfx.Read<addr_t>(objStartAddr + i * 4), true);
-
-		geo_t geo;
+	// Vertices and polygons are read separately by ReadModelGeometry, either for all models at
+	// once at the end of LoadLevel or when the model is first needed in lazy mode
+	model->geometryPending = true;
+}
 
-		geo.isLevel = false;
-		geo.vertexCount = dfx.Read<u16>(0, true);
-		geo.vertexAddress = dfx.Read<addr_t>(2, true);
-		geo.polygonCount = dfx.Read<u16>(8, true);
-		geo.polygonAddress = dfx.Read<addr_t>(2, true);
-		geo.boneCount = dfx.Read<u16>(0, true);
-		geo.boneAddress = dfx.Read<addr_t>(2, true);
-		geo.textureAnimAddress = dfx.Read<addr_t>(0, true);
+void ReadModelGeometry(file_t& dfx, level_t& level, levelext_t& levelData, std::shared_ptr<Model> model)
+{
+	model->geometryPending = false;
 
-		ReadVertices(dfx, level, levelData, geo, model);
-		ReadPolygons(dfx, level, levelData, geo, model);
-	}
+	const cursor_t header = DFX::ModelRecord::Table(dfx, model->addr, 1);
+	if (!header)
+		return;
 
-	dfx.pop();
+	auto [objCount, objStartAddr, modelNameAddr] = DFX::ModelRecord::Unpack(header, 0);
+	ReadObjectParts(dfx, level, levelData, model, objCount, objStartAddr);
 }
 
 std::shared_ptr<Model> CreatePathPointObject(level_t& level, addr_t addr)
@@ -641,204 +630,91 @@ void AddLineToModel(std::shared_ptr<Model> model, glm::vec3 start, glm::vec3 end
 
 void ReadMovingPlatform(file_t& dfx, level_t& level, addr_t ownerAddr, addr_t platformAddr)
 {
-	dfx.seek(platformAddr);
-	addr_t pathStart = dfx.Read<addr_t>(0);
-	addr_t rotsAddr = dfx.Read<addr_t>(4);
+	const cursor_t platform = DFX::PlatformRecord::Table(dfx, platformAddr, 1);
+	if (!platform)
+		return;
+
+	auto [pathStart, rotsAddr] = DFX::PlatformRecord::Unpack(platform, 0);
 	if (pathStart == 0 || platformAddr == 0)
 		return;
 	
-	dfx.seek(pathStart, true);
-	addr_t pointsAddr = dfx.Read<addr_t>(0);
-	u16 nPoints = dfx.Read<u16>(4);
-	level.paths.push_back({dfx.baseOffset, ownerAddr});
-	dfx.seek(pointsAddr, true);
-	for (u16 i = 0; i < nPoints; ++i)
+	const cursor_t path = DFX::ListRecord::Table(dfx, pathStart, 1);
+	if (!path)
+		return;
+
+	auto [pointsAddr, nPoints] = DFX::ListRecord::Unpack(path, 0);
+	level.paths.push_back({(unsigned int)dfx.baseOffset, ownerAddr});
+	if (const cursor_t points = DFX::PathPointRecord::Table(dfx, pointsAddr, nPoints))
 	{
-		level.paths.back().points.push_back({
-			dfx.Read<u16>(i * 0x20 + 0),
-			dfx.Read<i16>(i * 0x20 + 2),
-			dfx.Read<i16>(i * 0x20 + 4),
-			dfx.Read<i16>(i * 0x20 + 6)
-		});
+		auto& pathPoints = level.paths.back().points;
+		pathPoints.resize(nPoints);
+		DFX::PathPointRecord::DecodeInto<&PathPoint::speed, &PathPoint::x, &PathPoint::y, &PathPoint::z>(points, nPoints, pathPoints.data());
 	}
 
 	if (rotsAddr == 0)
 		return;
 
-	dfx.seek(rotsAddr, true);
-	u16 nRots = dfx.Read<u16>(4);
-	dfx.seek(dfx.Read<addr_t>(0), true);
-	constexpr float c_PI_2_FROM_1024 = glm::pi<float>() / 2048.f;
-	for (u16 i = 0; i < nRots; ++i)
-	{
-		level.paths.back().rotations.push_back({
-			dfx.Read<u16>(i * 10 + 0),
-			dfx.Read<i16>(i * 10 + 2) * (1.f / 0x1000),
-			dfx.Read<i16>(i * 10 + 4) * (1.f / 0x1000),
-			dfx.Read<i16>(i * 10 + 6) * (1.f / 0x1000),
-			dfx.Read<i16>(i * 10 + 8) * (-1.f / 0x1000)
-			});
-	}
+	const cursor_t rotsHeader = DFX::ListRecord::Table(dfx, rotsAddr, 1);
+	if (!rotsHeader)
+		return;
 
-	dfx.pop();
+	auto [rotsListAddr, nRots] = DFX::ListRecord::Unpack(rotsHeader, 0);
+	const cursor_t rots = DFX::PathRotationRecord::Table(dfx, rotsListAddr, nRots);
+	if (!rots)
+		return;
+
+	auto& rotations = level.paths.back().rotations;
+	rotations.reserve(nRots);
+	DFX::PathRotationRecord::ForEach(rots, nRots, [&rotations](size_t, u16 speed, i16 x, i16 y, i16 z, i16 w)
+		{
+			rotations.push_back({
+				speed,
+				x * (1.f / 0x1000),
+				y * (1.f / 0x1000),
+				z * (1.f / 0x1000),
+				w * (-1.f / 0x1000)
+				});
+		});
 }
 
 void ReadObjectInstance(file_t& dfx, level_t& level, levelext_t& levelData, addr_t instanceAddr)
 {
-	dfx.seek(instanceAddr);
-	addr_t modelAddr = dfx.Read<addr_t>(0);
-	u32 modelIndex = 0;
-	for (auto& m : level.models)
+	const cursor_t instance = DFX::InstanceRecord::Table(dfx, instanceAddr, 1);
+	if (!instance)
 	{
-		if (m->addr == modelAddr)
-			break;
-		++modelIndex;
+		printf("Object instance at %x is out of bounds!\n", instanceAddr);
+		return;
 	}
 
-	if (modelIndex == level.models.size())
+	auto [modelAddr, rotX, rotY, rotZ, posX, posY, posZ, data0, data1, data2, data3] = DFX::InstanceRecord::Unpack(instance, 0);
+	u32 modelIndex;
+	if (auto it = levelData.modelIndices.find(modelAddr); it != levelData.modelIndices.end())
+	{
+		modelIndex = it->second;
+	}
+	else
 	{
+		// Not seen by the pre-scan in LoadLevel, so its geometry stays pending until then
+		modelIndex = (u32)level.models.size();
+		levelData.modelIndices.emplace(modelAddr, modelIndex);
 		ReadObjectGeometry(dfx, level, levelData, modelAddr);
 	}
 	
 	constexpr float c_PI_2_FROM_1024 = glm::pi<float>() / 2048.f;
-	glm::vec3 rot = { dfx.Read<i16>(10) * c_PI_2_FROM_1024, dfx.Read<i16>(12) * -c_PI_2_FROM_1024, dfx.Read<i16>(14) * c_PI_2_FROM_1024 };
-	glm::vec3 pos = { -dfx.Read<i16>(16) * 0.001f, -dfx.Read<i16>(20) * 0.001f, dfx.Read<i16>(18) * 0.001f };
-	level.models[modelIndex]->instances.push_back({ pos, rot, true, instanceAddr + dfx.baseOffset,
-		{
-			dfx.Read<u32>(0x20),
-			dfx.Read<u32>(0x24),
-			dfx.Read<u32>(0x28),
-			dfx.Read<u32>(0x2C),
-		}
-	});
-
-	dfx.pop();
-
-#define ADDCOMPONENT(Type, Offset) level.models[modelIndex]->instances.back().AddComponent<Type>().ParseData(dfx, level, level.models[modelIndex]->instances.back().instanceData[Offset]);
+	glm::vec3 rot = { rotX * c_PI_2_FROM_1024, rotY * -c_PI_2_FROM_1024, rotZ * c_PI_2_FROM_1024 };
+	glm::vec3 pos = { -posX * 0.001f, -posZ * 0.001f, posY * 0.001f };
+	level.models[modelIndex]->instances.push_back({ pos, rot, true, instanceAddr + (unsigned int)dfx.baseOffset, { data0, data1, data2, data3 } });
 
 	// Custom parsing for some stuff
-	std::vector<const char*> listOfPlatformTypes = {
-		"mplat___",
-		"flttblb_",
-		"flttbl__",
-		"finplat_",
-		"tbplat__",
-		"cart____",
-
-		"fltdesk_",
-		"fltchst_",
-
-		"tube____",
-		"tubegls_",
-
-		"kplat___",
-		"kplatb__",
-		"kplatc__",
-		"kplatd__",
-
-		"kswing__",
-		"kngdmnd_",
-		"const___",
-
-		"jimbloc_",
-		"jplat___",
-		"frocket_",
-		"jimboat_",
-		"logturn_",
-		"jimplts_",
-		"bldrgen_",
-
-		"flyplat_",
-		"jimplat_",
-
-		"qsauc___",
-		"rocket__",
-		"astplta_",
-		"darkshp_",
-
-		"darksop_",
-		"splat___",
-		"astpltb_",
-		"poop____", // why, these are just space platforms
-		"poopqq__",
-		"poopz___",
-		"qplat___",
-		"qsmall__",
-
-		"qelev___",
-		"qpad____",
-		"qdoor___",
-		"qbars___",
-		"qsdoor__",
-		"qssdoor_",
-		"discoff_",
-		"lvltv___",
-		"jaw_____",
-
-		"aztcflr_",
-		"aztcwl__",
-		"aztcbs__",
-		"aztcbks_",
-		"trndor__",
-		"gengen__",
-		"rockplt_",
-
-		"bee_____",
-		"rzstart_",
-		"rzbrain_",
-		"follow__",
-		"node____",
-		"pulse___",
-		"mspider_",
-		"rebggen_",
-		"rezsoul_",
-		"choppa__",
-		"tankb___",
-
-		"hrblock_",
-		"hrswtch_",
-		"reza____",
-		"skel____",
-		"hhelev__",
-
-		"draga___",
-		"kbgen___",
-		"moo_____",
-		"shark___",
-
-		"blastx__",
-		"blasty__",
-		"tvgen___",
-		"tvgurny_",
-		"mutant__",
-		"scorp___",
-		"sewertp_",
-		"casdraw_",
-
-		"@Path",
-	};
-	for (auto& n : listOfPlatformTypes)
+	if (const objecttype_t* type = FindObjectType(level.models[modelIndex]->name))
 	{
-		if (level.models[modelIndex]->name == n)
+		for (auto parser : type->components)
 		{
-			ADDCOMPONENT(PathComponent, 2);
-			break;
+			if (parser)
+				parser(dfx, level, level.models[modelIndex]->instances.back());
 		}
 	}
 
-
-	if (level.models[modelIndex]->name == "lvltv___")
-	{
-		ADDCOMPONENT(LevelTVComponent, 0);
-	}
-	
-	if (level.models[modelIndex]->name == "powertv_" || level.models[modelIndex]->name == "circitv_")
-	{
-		ADDCOMPONENT(FlyBoxComponent, 0);
-	}
-
-#undef ADDCOMPONENT
-
 	//if (level.models[modelIndex]->name == "qmark___")
 	//{
 	//	auto& inst = *level.models[modelIndex]->instances.rbegin();
@@ -865,26 +741,6 @@ void ReadObjectInstance(file_t& dfx, level_t& level, levelext_t& levelData, addr
 	//}
 }
 
-struct GexTex_t
-{
-	struct TexInfo_t
-	{
-		GrLOD_t smallLod;
-		GrLOD_t largeLod;
-		GrAspectRatio_t aspectRatio;
-		GrTextureFormat_t format;
-	} info;
-	struct NCCTable_t
-	{
-		FxU8 yRGB[16];
-		FxI16 iRGB[4][3];
-		FxI16 qRGB[4][3];
-		FxU32 packed_data[12];
-	} ncctable;
-	FxU32 smallLodBytes;
-	FxU32 largeLodBytes;
-};
-
 auto GetImageSizeFromTexture(GrLOD_t lod, GrAspectRatio_t aspect)
 {
 	struct size
@@ -920,58 +776,67 @@ auto GetImageSizeFromTexture(GrLOD_t lod, GrAspectRatio_t aspect)
 	}
 }
 
-glm::vec4* ConvertARGB4444(file_t& vfx, const GexTex_t& tex)
+// Folds the alpha of n texels into what's been seen of the texture so far
+ETextureAlpha ClassifyAlpha(const rgba8_t* texels, size_t n, ETextureAlpha alpha)
 {
-	auto [w, h] = GetImageSizeFromTexture(tex.info.largeLod, tex.info.aspectRatio);
-
-	glm::vec4* buffer = new glm::vec4[w * h];
-
-	for (size_t i = 0; i < tex.largeLodBytes / 2; ++i)
+	for (size_t i = 0; i < n && alpha != ETextureAlpha::Translucent; ++i)
 	{
-		FxU16 pixel_data = vfx.Read<FxU16>(0, true);
-#pragma warning(push)
-#pragma warning(disable: 6386)
-		buffer[i] = {
-			(FxU8)(((pixel_data & 0x0F00) >> 8) * 0x11),
-			(FxU8)(((pixel_data & 0x00F0) >> 4) * 0x11),
-			(FxU8)(((pixel_data & 0x000F)) * 0x11),
-			(FxU8)(((pixel_data & 0xF000) >> 12) * 0x11)
-		};
-#pragma warning(pop)
+		if (texels[i].a == 0)
+			alpha = ETextureAlpha::Cutout;
+		else if (texels[i].a != 255)
+			alpha = ETextureAlpha::Translucent;
 	}
+	return alpha;
+}
 
-	return buffer;
+// Decodes a w x h texture row by row into dst, an image that is stride texels wide. decodeRow(first, n, row)
+// converts n texels starting at texel first. Texels past count (short texture data) are cleared.
+// Every row is classified while it's still in cache, the result is the class of the whole texture.
+template<typename Fn>
+ETextureAlpha DecodeRows(size_t count, u32 w, u32 h, rgba8_t* dst, size_t stride, Fn&& decodeRow)
+{
+	ETextureAlpha alpha = ETextureAlpha::Opaque;
+	for (u32 y = 0; y < h; ++y)
+	{
+		const size_t first = (size_t)y * w;
+		const size_t n = first < count ? std::min<size_t>(w, count - first) : 0;
+		rgba8_t* row = dst + y * stride;
+		if (n != 0)
+			decodeRow(first, n, row);
+		std::fill(row + n, row + w, rgba8_t{});
+		alpha = ClassifyAlpha(row, w, alpha);
+	}
+	return alpha;
 }
 
-glm::vec4* ConvertARGB1555(file_t& vfx, const GexTex_t& tex)
+ETextureAlpha ConvertARGB4444(const cursor_t& texels, const GexTex_t& tex, rgba8_t* dst, size_t stride)
 {
 	auto [w, h] = GetImageSizeFromTexture(tex.info.largeLod, tex.info.aspectRatio);
 
-	glm::vec4* buffer = new glm::vec4[w * h];
+	const size_t count = std::min<size_t>(tex.largeLodBytes / 2, w * h);
+	return DecodeRows(count, w, h, dst, stride, [&texels](size_t first, size_t n, rgba8_t* row)
+		{
+			DecodeARGB4444(texels.ptr(first * 2), n, row);
+		});
+}
 
-	for (size_t i = 0; i < tex.largeLodBytes / 2; ++i)
-	{
-		FxU16 pixel_data = vfx.Read<FxU16>(0, true);
-#pragma warning(push)
-#pragma warning(disable: 6386)
-		buffer[i] = {
-			(FxU8)(((pixel_data >> 10) & 0x1F) * 0x08),
-			(FxU8)(((pixel_data >> 5) & 0x1F) * 0x08),
-			(FxU8)(((pixel_data) & 0x1F) * 0x8),
-			(FxU8)(((pixel_data & 0x8000) ? 0xFF : 0x00))
-		};
-#pragma warning(pop)
-	}
+// With cutout, black texels come out transparent as well
+ETextureAlpha ConvertARGB1555(const cursor_t& texels, const GexTex_t& tex, rgba8_t* dst, size_t stride, bool cutout)
+{
+	auto [w, h] = GetImageSizeFromTexture(tex.info.largeLod, tex.info.aspectRatio);
 
-	return buffer;
+	const size_t count = std::min<size_t>(tex.largeLodBytes / 2, w * h);
+	const auto decode = cutout ? DecodeARGB1555Cutout : DecodeARGB1555;
+	return DecodeRows(count, w, h, dst, stride, [&texels, decode](size_t first, size_t n, rgba8_t* row)
+		{
+			decode(texels.ptr(first * 2), n, row);
+		});
 }
 
-glm::vec4* ConvertYIQ422(file_t& vfx, const GexTex_t& tex)
+ETextureAlpha ConvertYIQ422(const cursor_t& texels, const GexTex_t& tex, rgba8_t* dst, size_t stride)
 {
 	auto [w, h] = GetImageSizeFromTexture(tex.info.largeLod, tex.info.aspectRatio);
 
-	glm::vec4* buffer = new glm::vec4[w * h];
-
 	GexTex_t::NCCTable_t ncc;
 	const GexTex_t::NCCTable_t* ncc1 = &tex.ncctable;
 	memcpy(&ncc, ncc1, sizeof(GexTex_t::NCCTable_t));
@@ -993,10 +858,10 @@ glm::vec4* ConvertYIQ422(file_t& vfx, const GexTex_t& tex)
 			ncc.qRGB[i][2] |= 0xff00;
 	}
 
-	for (size_t i = 0; i < tex.largeLodBytes; ++i)
+	// Every texel is a single index byte, so all 256 colours are worked out once up front
+	rgba8_t lut[256];
+	for (int in = 0; in < 256; ++in)
 	{
-		FxU8 in = vfx.Read<FxU8>(0, true);
-
 		FxI32 R = (FxI32)ncc.yRGB[in >> 4] + ncc.iRGB[(in >> 2) & 0x3][0]
 			+ ncc.qRGB[(in) & 0x3][0];
 
@@ -1010,126 +875,438 @@ glm::vec4* ConvertYIQ422(file_t& vfx, const GexTex_t& tex)
 		G = ((G < 0) ? 0 : ((G > 255) ? 255 : G));
 		B = ((B < 0) ? 0 : ((B > 255) ? 255 : B));
 
-#pragma warning(push)
-#pragma warning(disable: 6386)
-		buffer[i] = {
+		lut[in] = {
 			(FxU8)(R), (FxU8)(G), (FxU8)(B), 0xFF
 		};
-#pragma warning(pop)
-
-		++in;
 	}
 
-	return buffer;
+	const size_t count = std::min<size_t>(tex.largeLodBytes, w * h);
+	const FxU8* indices = texels.ptr<FxU8>();
+	return DecodeRows(count, w, h, dst, stride, [indices, &lut](size_t first, size_t n, rgba8_t* row)
+		{
+			for (size_t i = 0; i < n; ++i)
+				row[i] = lut[indices[first + i]];
+		});
 }
 
-glm::vec4* ReadTexture(file_t& vfx, const GexTex_t& tex)
+// Decodes the texture into dst, which is stride texels wide, and classifies its alpha.
+// cutout only applies to ARGB1555 textures. Returns false for unsupported formats.
+bool ReadTexture(const cursor_t& texels, const GexTex_t& tex, rgba8_t* dst, size_t stride, bool cutout, ETextureAlpha& alpha)
 {
 	switch (tex.info.format)
 	{
 	case GrTextureFormat_t::GR_TEXFMT_ARGB_4444:
-		return ConvertARGB4444(vfx, tex);
+		alpha = ConvertARGB4444(texels, tex, dst, stride);
+		return true;
 
 	case GrTextureFormat_t::GR_TEXFMT_ARGB_1555:
-		return ConvertARGB1555(vfx, tex);
+		alpha = ConvertARGB1555(texels, tex, dst, stride, cutout);
+		return true;
 
 	case GrTextureFormat_t::GR_TEXFMT_YIQ_422:
-		return ConvertYIQ422(vfx, tex);
+		alpha = ConvertYIQ422(texels, tex, dst, stride);
+		return true;
 
 	default:
 		printf("Unknown type: %d\n", tex.info.format);
-		return NULL;
+		return false;
 	}
 }
 
 void BlitTex(texture_t& dst, const texture_t& src, int x, int y)
 {
 	for (u32 yi = 0; yi < src.h; ++yi)
+		memcpy(&dst.pixels[(y + yi) * dst.w + x], &src.pixels[yi * src.w], src.w * sizeof(rgba8_t));
+}
+
+// Magenta 64x64 checkers, used where the sheet has nothing to show
+void FillCheckerboard(texture_t& sheet, int x, int y, int w, int h)
+{
+	for (int yi = y; yi < y + h; ++yi)
+	{
+		rgba8_t* row = &sheet.pixels[yi * sheet.w];
+		for (int xi = x; xi < x + w; ++xi)
+			row[xi] = ((xi ^ yi) & 64) == 0 ? rgba8_t{ 255, 0, 255, 255 } : rgba8_t{ 128, 0, 128, 255 };
+	}
+}
+
+// Fills every part of the sheet that no packed image covers, the rest gets decoded over anyway
+void FillUnusedSheet(texture_t& sheet, const ImagePacker::ImageInformationList& list)
+{
+	std::vector<const ImagePacker::ImageInformation_t*> sorted;
+	sorted.reserve(list.size());
+	for (auto& info : list)
+		sorted.push_back(&info);
+	std::sort(sorted.begin(), sorted.end(), [](auto a, auto b) { return a->x < b->x; });
+
+	std::vector<const ImagePacker::ImageInformation_t*> row;
+	for (int y = 0; y < (int)sheet.h; ++y)
 	{
-		for (u32 xi = 0; xi < src.w; ++xi)
+		row.clear();
+		for (auto info : sorted)
+			if (y >= info->y && y < info->y + info->height)
+				row.push_back(info);
+
+		int x = 0;
+		for (auto info : row)
 		{
-			dst.pixels[(y + yi) * dst.w + (x + xi)] = src.pixels[yi * src.w + xi];
+			if (info->x > x)
+				FillCheckerboard(sheet, x, y, info->x - x, 1);
+			x = std::max(x, info->x + info->width);
 		}
+		if (x < (int)sheet.w)
+			FillCheckerboard(sheet, x, y, sheet.w - x, 1);
 	}
 }
 
-void LoadTextures(const std::string& filepath, level_t& level)
+// Free border around every image in the sheet, filled with the image's edges so linear filtering and
+// the first few mip levels don't pick up the neighbours. Also limits the mip chain, see BuildSheetMips.
+constexpr int c_SHEETPADDING = 8;
+
+// How the sheet is packed. The skyline packs the same sheets as the tree in a fraction of the time.
+constexpr ImagePacker::EStrategy c_SHEETPACKING = ImagePacker::EStrategy::Skyline;
+
+// Copies the edges of every packed image outwards over its border
+void FillGutters(texture_t& sheet, const ImagePacker::ImageInformationList& list, int padding)
 {
-	file_t vfx;
-	if (!ReadFile(filepath, vfx))
+	const int sw = (int)sheet.w, sh = (int)sheet.h;
+	for (auto& info : list)
+	{
+		if (info.width <= 0 || info.height <= 0)
+			continue;
+
+		const int x0 = std::max(info.x - padding, 0), x1 = std::min(info.x + info.width + padding, sw);
+		const int y0 = std::max(info.y - padding, 0), y1 = std::min(info.y + info.height + padding, sh);
+		for (int y = y0; y < y1; ++y)
+		{
+			rgba8_t* row = &sheet.pixels[y * sw];
+			const rgba8_t* srcRow = &sheet.pixels[std::clamp(y, info.y, info.y + info.height - 1) * sw];
+			if (y < info.y || y >= info.y + info.height)
+				memcpy(&row[info.x], &srcRow[info.x], info.width * sizeof(rgba8_t));
+			for (int x = x0; x < info.x; ++x)
+				row[x] = srcRow[info.x];
+			for (int x = info.x + info.width; x < x1; ++x)
+				row[x] = srcRow[info.x + info.width - 1];
+		}
+	}
+}
+
+rgba8_t Average(const rgba8_t& a, const rgba8_t& b, const rgba8_t& c, const rgba8_t& d)
+{
+	return {
+		(unsigned char)((a.r + b.r + c.r + d.r + 2) >> 2),
+		(unsigned char)((a.g + b.g + c.g + d.g + 2) >> 2),
+		(unsigned char)((a.b + b.b + c.b + d.b + 2) >> 2),
+		(unsigned char)((a.a + b.a + c.a + d.a + 2) >> 2)
+	};
+}
+
+// Refills the gutters and rebuilds level.sheetMips from the sheet. Every mip is a 2x2 box filter of the
+// previous one, but texels around a packed image only average that image's own texels (clamped to its
+// edges), so nothing bleeds in from the neighbours. The chain stops once the border would be gone.
+void BuildSheetMips(level_t& level)
+{
+	for (auto& mip : level.sheetMips)
+		delete[] mip.pixels;
+	level.sheetMips.clear();
+	if (!level.sheet.pixels)
 		return;
 
-	u32 numTex = vfx.Read<u32>(0);
+	FillGutters(level.sheet, level.list, c_SHEETPADDING);
 
-	vfx.baseOffset = 4;
-	GexTex_t gexTex;
-	for (u32 i = 0; i < numTex; ++i)
+	const texture_t* src = &level.sheet;
+	for (int k = 1; (c_SHEETPADDING >> k) > 0 && src->w > 1 && src->h > 1; ++k)
 	{
-		gexTex.info.smallLod = vfx.Read<GrLOD_t>(0, true);
-		gexTex.info.largeLod = vfx.Read<GrLOD_t>(0, true);
-		gexTex.info.aspectRatio = vfx.Read<GrAspectRatio_t>(0, true);
-		gexTex.info.format = vfx.Read<GrTextureFormat_t>(0, true);
-		(void)vfx.Read<FxU32>(0, true); // addr
-		for (int i = 0; i < 16; ++i)
-			gexTex.ncctable.yRGB[i] = vfx.Read<FxU8>(0, true);
+		texture_t mip{ src->w / 2, src->h / 2, new rgba8_t[(src->w / 2) * (src->h / 2)] };
+
+		// Plain box filter first, that covers the unused parts of the sheet
+		for (u32 y = 0; y < mip.h; ++y)
+		{
+			const rgba8_t* row0 = &src->pixels[(y * 2) * src->w];
+			const rgba8_t* row1 = row0 + src->w;
+			for (u32 x = 0; x < mip.w; ++x)
+				mip.pixels[y * mip.w + x] = Average(row0[x * 2], row0[x * 2 + 1], row1[x * 2], row1[x * 2 + 1]);
+		}
+
+		// Then every image and its border again, only sampling inside the image
+		const int step = 1 << (k - 1);
+		for (auto& info : level.list)
+		{
+			if (info.width <= 0 || info.height <= 0)
+				continue;
+
+			// The image's rectangle on the previous level
+			const int ix0 = info.x / step, ix1 = (info.x + info.width + step - 1) / step - 1;
+			const int iy0 = info.y / step, iy1 = (info.y + info.height + step - 1) / step - 1;
+
+			const int px0 = std::max((info.x - c_SHEETPADDING) >> k, 0);
+			const int px1 = std::min((info.x + info.width + c_SHEETPADDING + (1 << k) - 1) >> k, (int)mip.w);
+			const int py0 = std::max((info.y - c_SHEETPADDING) >> k, 0);
+			const int py1 = std::min((info.y + info.height + c_SHEETPADDING + (1 << k) - 1) >> k, (int)mip.h);
+			for (int y = py0; y < py1; ++y)
+			{
+				const rgba8_t* row0 = &src->pixels[std::clamp(y * 2, iy0, iy1) * src->w];
+				const rgba8_t* row1 = &src->pixels[std::clamp(y * 2 + 1, iy0, iy1) * src->w];
+				for (int x = px0; x < px1; ++x)
+				{
+					const int sx0 = std::clamp(x * 2, ix0, ix1), sx1 = std::clamp(x * 2 + 1, ix0, ix1);
+					mip.pixels[y * mip.w + x] = Average(row0[sx0], row0[sx1], row1[sx0], row1[sx1]);
+				}
+			}
+		}
+
+		level.sheetMips.push_back(mip);
+		src = &level.sheetMips.back();
+	}
+}
+
+// Size of a texture header in the VFX, the texel data follows right after it
+constexpr size_t c_VFXHEADERSIZE = 0x8C;
+
+// The parts of a texture that its decoded image depends on are the same
+bool IsSameTexture(const file_t& vfx, const vfxentry_t& a, const vfxentry_t& b)
+{
+	if (a.tex.info.largeLod != b.tex.info.largeLod || a.tex.info.aspectRatio != b.tex.info.aspectRatio ||
+		a.tex.info.format != b.tex.info.format || a.tex.largeLodBytes != b.tex.largeLodBytes)
+		return false;
+	if (a.tex.info.format == GrTextureFormat_t::GR_TEXFMT_YIQ_422 && memcmp(&a.tex.ncctable, &b.tex.ncctable, sizeof(GexTex_t::NCCTable_t)) != 0)
+		return false;
+	return memcmp(vfx.At(a.texelOffset, a.tex.largeLodBytes).ptr(), vfx.At(b.texelOffset, b.tex.largeLodBytes).ptr(), a.tex.largeLodBytes) == 0;
+}
+
+// Whether making the texture a cutout changes it, which only happens to opaque black ARGB1555 texels
+bool HasCutoutTexels(const file_t& vfx, const vfxentry_t& entry)
+{
+	if (entry.tex.info.format != GrTextureFormat_t::GR_TEXFMT_ARGB_1555)
+		return false;
+
+	const cursor_t texels = vfx.At(entry.texelOffset, entry.tex.largeLodBytes);
+	for (size_t i = 0; i + 2 <= texels.size; i += 2)
+		if (texels.Read<u16>(i) == 0x8000)
+			return true;
+	return false;
+}
 
-		for (int y = 0; y < 4; ++y)
-			for (int x = 0; x < 3; ++x)
-				gexTex.ncctable.iRGB[y][x] = vfx.Read<FxI16>(0, true);
+// Walks the VFX once and records every texture whose header and texels are in the file. Textures that
+// decode to the same image as an earlier one (same format, texels and NCC table) are pointed at it,
+// unless they'd stop being the same once one of them is a cutout and the other isn't.
+bool IndexVFX(file_t& vfx, std::vector<vfxentry_t>& index)
+{
+	index.clear();
+	const cursor_t count = vfx.At(0, 4);
+	if (!count)
+		return false;
 
-		for (int y = 0; y < 4; ++y)
-			for (int x = 0; x < 3; ++x)
-				gexTex.ncctable.qRGB[y][x] = vfx.Read<FxI16>(0, true);
+	u32 numTex = count.Read<u32>(0);
+	index.reserve(numTex);
 
-		for (int i = 0; i < 12; ++i)
-			gexTex.ncctable.packed_data[i] = vfx.Read<FxU32>(0, true);
+	std::unordered_map<uint64_t, u32> firstByHash;
+	size_t offset = 4;
+	for (u32 i = 0; i < numTex; ++i)
+	{
+		const cursor_t header = vfx.At(offset, c_VFXHEADERSIZE);
+		if (!header)
+			break;
 
-		gexTex.smallLodBytes = vfx.Read<FxU32>(0, true);
-		gexTex.largeLodBytes = vfx.Read<FxU32>(0, true);
+		vfxentry_t entry;
+		GexTex_t& gexTex = entry.tex;
+		gexTex.info.smallLod = header.Read<GrLOD_t>(0);
+		gexTex.info.largeLod = header.Read<GrLOD_t>(4);
+		gexTex.info.aspectRatio = header.Read<GrAspectRatio_t>(8);
+		gexTex.info.format = header.Read<GrTextureFormat_t>(12);
+		// 16 is the texture address
+		header.ReadArray(20, gexTex.ncctable.yRGB, 16);
+		header.ReadArray(36, &gexTex.ncctable.iRGB[0][0], 12);
+		header.ReadArray(60, &gexTex.ncctable.qRGB[0][0], 12);
+		header.ReadArray(84, gexTex.ncctable.packed_data, 12);
+		gexTex.smallLodBytes = header.Read<FxU32>(132);
+		gexTex.largeLodBytes = header.Read<FxU32>(136);
+
+		entry.texelOffset = offset + c_VFXHEADERSIZE;
+		if (!vfx.At(entry.texelOffset, gexTex.largeLodBytes))
+			break;
+		offset = entry.texelOffset + gexTex.largeLodBytes;
 
-		auto t = ReadTexture(vfx, gexTex);
 		auto [w, h] = GetImageSizeFromTexture(gexTex.info.largeLod, gexTex.info.aspectRatio);
-		if (t != NULL)
+		entry.w = w;
+		entry.h = h;
+
+		const u32 key[4] = { (u32)gexTex.info.largeLod, (u32)gexTex.info.aspectRatio, (u32)gexTex.info.format, gexTex.largeLodBytes };
+		uint64_t hash = HashBytes(key, sizeof(key));
+		if (gexTex.info.format == GrTextureFormat_t::GR_TEXFMT_YIQ_422)
+			hash = HashBytes(&gexTex.ncctable, sizeof(GexTex_t::NCCTable_t), hash);
+		hash = HashBytes(vfx.At(entry.texelOffset, gexTex.largeLodBytes).ptr(), gexTex.largeLodBytes, hash);
+
+		// A colliding hash with different contents just keeps its own rectangle
+		auto [first, inserted] = firstByHash.try_emplace(hash, (u32)index.size());
+		if (!inserted && IsSameTexture(vfx, index[first->second], entry) && !HasCutoutTexels(vfx, entry))
+			entry.sharesWith = (int)first->second;
+		index.push_back(entry);
+	}
+	return true;
+}
+
+// Hands the decode state of every texture down to the ones sharing its rectangle
+void SyncSharedTextures(level_t& level)
+{
+	for (auto& texture : level.textures)
+	{
+		if (texture.sharesWith < 0)
+			continue;
+
+		const texture_t& shared = level.textures[texture.sharesWith];
+		texture.decoded = shared.decoded;
+		texture.cutout = shared.cutout;
+		texture.alpha = shared.alpha;
+	}
+}
+
+// A texture's rectangle and the border around it, clamped to the sheet
+sheetrect_t GetPaddedRect(const texture_t& sheet, const texture_t& texture)
+{
+	return {
+		std::max(texture.x - c_SHEETPADDING, 0),
+		std::max(texture.y - c_SHEETPADDING, 0),
+		std::min(texture.x + (int)texture.w + c_SHEETPADDING, (int)sheet.w),
+		std::min(texture.y + (int)texture.h + c_SHEETPADDING, (int)sheet.h)
+	};
+}
+
+// Decodes the listed VFX textures into their sheet rectangles, skipping any that already are.
+// Textures sharing a rectangle are decoded once, through the first of them.
+// Returns true if anything was decoded, the rectangles that were (with their border) are added to changed.
+bool DecodeTextures(file_t& vfx, const std::vector<vfxentry_t>& index, level_t& level, const std::vector<unsigned int>& ids, const std::stop_token& stop = {}, std::vector<sheetrect_t>* changed = nullptr)
+{
+	std::vector<unsigned int> pending;
+	for (unsigned int id : ids)
+	{
+		if (id >= index.size())
+			continue;
+		if (index[id].sharesWith >= 0)
+			id = index[id].sharesWith;
+		if (!level.textures[id].decoded && level.textures[id].x >= 0)
+			pending.push_back(id);
+	}
+	std::sort(pending.begin(), pending.end());
+	pending.erase(std::unique(pending.begin(), pending.end()), pending.end());
+
+	// Every texture has its own rectangle, so they can all be decoded at once
+	ThreadPool::Get().ParallelFor(pending.size(), [&](size_t i)
 		{
-			for (u32 ii = 0; ii < w * h; ++ii)
+			if (stop.stop_requested())
+				return;
+
+			texture_t& texture = level.textures[pending[i]];
+			const vfxentry_t& entry = index[pending[i]];
+			const cursor_t texels = vfx.At(entry.texelOffset, entry.tex.largeLodBytes);
+			if (!ReadTexture(texels, entry.tex, &level.sheet.pixels[texture.y * level.sheet.w + texture.x], level.sheet.w, texture.cutout, texture.alpha))
 			{
-				auto& pixel = t[ii];
-				pixel.r /= 255.f;
-				pixel.g /= 255.f;
-				pixel.b /= 255.f;
-				pixel.a /= 255.f;
+				FillCheckerboard(level.sheet, texture.x, texture.y, texture.w, texture.h);
+				texture.alpha = ETextureAlpha::Opaque;
 			}
+			texture.decoded = true;
+		});
+
+	if (pending.empty())
+		return false;
+	if (changed)
+		for (unsigned int id : pending)
+			changed->push_back(GetPaddedRect(level.sheet, level.textures[id]));
+	SyncSharedTextures(level);
+	return true;
+}
+
+// Marks the textures used by the model's polygons as referenced, adding the ones that weren't yet to ids
+void ReferenceTextures(level_t& level, const Model& model, std::vector<unsigned int>& ids)
+{
+	for (auto& poly : model.polygons)
+	{
+		if (poly.materialID < level.textures.size() && !level.textures[poly.materialID].referenced)
+		{
+			level.textures[poly.materialID].referenced = true;
+			ids.push_back(poly.materialID);
 		}
-		if (auto info = FindImageInfoById(level.list, i))
+	}
+}
+
+// Flags the queued ARGB1555 textures as cutouts and empties the queue. They're decoded with their black
+// texels transparent from then on, the ones that already were decoded without it are added to ids to
+// be decoded again.
+// A cutout applies to the shared rectangle. Only textures a cutout doesn't change share one, so the
+// others using it look the same either way.
+void MarkCutouts(level_t& level, std::set<unsigned int>& materialsToFix, std::vector<unsigned int>& ids)
+{
+	for (auto mat : materialsToFix)
+	{
+		if (mat < level.textures.size() && level.textures[mat].sharesWith >= 0)
+			mat = level.textures[mat].sharesWith;
+		if (mat >= level.textures.size() || !level.textures[mat].argb1555 || level.textures[mat].cutout)
+			continue;
+
+		texture_t& texture = level.textures[mat];
+		texture.cutout = true;
+		if (texture.decoded)
 		{
-			BlitTex(level.sheet, texture_t{ w, h, t }, info->x, info->y);
+			texture.decoded = false;
+			ids.push_back(mat);
 		}
-		//delete[] t;
-		level.textures.push_back(texture_t{ w, h, t, true, gexTex.info.format == GrTextureFormat_t::GR_TEXFMT_ARGB_1555 });
 	}
-	
+	materialsToFix.clear();
+}
+
+// Lays out level.textures from the index and, with decodeAll, decodes them. ARGB1555 textures are left
+// out of that, whether they're cutouts is only known once the geometry has been read.
+void LoadTextures(file_t& vfx, const std::vector<vfxentry_t>& index, level_t& level, const std::vector<texture_t>& customImages, bool decodeAll, const std::stop_token& stop)
+{
+	// Rectangles first, the texels are decoded straight into the sheet afterwards
+	level.textures.reserve(index.size() + customImages.size());
+	std::vector<unsigned int> ids;
+	ids.reserve(index.size());
+	for (u32 i = 0; i < index.size(); ++i)
+	{
+		const vfxentry_t& entry = index[i];
+		texture_t texture{ entry.w, entry.h, NULL, false, entry.tex.info.format == GrTextureFormat_t::GR_TEXFMT_ARGB_1555 };
+		texture.sharesWith = entry.sharesWith;
+		if (auto info = FindImageInfoById(level.list, entry.sharesWith >= 0 ? entry.sharesWith : i))
+		{
+			texture.x = info->x;
+			texture.y = info->y;
+		}
+		level.textures.push_back(texture);
+		if (!texture.argb1555 && entry.sharesWith < 0)
+			ids.push_back(i);
+	}
+
+	if (decodeAll)
+		DecodeTextures(vfx, index, level, ids, stop);
+	if (stop.stop_requested())
+		return;
+
 	for(size_t i = 0; i < customImages.size(); ++i)
 	{
+		texture_t texture{ customImages[i].w, customImages[i].h, NULL, false };
 		if (auto info = FindImageInfoById(level.list, ECustomImageType::CUSTOM_IMAGE_BASE + i))
 		{
 			BlitTex(level.sheet, customImages[i], info->x, info->y);
+			texture.x = info->x;
+			texture.y = info->y;
+			texture.decoded = true;
+			texture.alpha = ClassifyAlpha(customImages[i].pixels, customImages[i].w * customImages[i].h, ETextureAlpha::Opaque);
 		}
-		level.textures.push_back(customImages[i]);
+		level.textures.push_back(texture);
 	}
 }
 
-void LoadCustomImages()
+std::vector<texture_t> LoadCustomImages()
 {
-	if (!customImages.empty())
-		return;
-
+	std::vector<texture_t> customImages;
 	file_t file;
 	std::string rootType = "..";
 	if (!ReadFile("../data/images/spawn.png", file))
 	{
 		rootType = ".";
 		if (!ReadFile("./data/images/spawn.png", file))
-			return; // Failed to open both files
+			return customImages; // Failed to open both files
 	}
 
 	file.Close();
@@ -1146,54 +1323,67 @@ void LoadCustomImages()
 	{
 		if (ReadFile(rootType + fileName, file))
 		{
+			const cursor_t header = file.At(0, 10);
+			if (!header)
+				continue;
+
 			texture_t image;
-			image.w = file.Read<u32>(0);
-			image.h = file.Read<u32>(4);
+			image.w = header.Read<u32>(0);
+			image.h = header.Read<u32>(4);
 
-			const unsigned short nPalette = file.Read<u16>(8);
-			std::vector<glm::vec4> palette;
+			const unsigned short nPalette = header.Read<u16>(8);
+			const cursor_t paletteData = file.At(10, 4 * nPalette + 1);
+			if (!paletteData)
+				continue;
+
+			std::vector<rgba8_t> palette;
 			for (int i = 0; i < nPalette; ++i)
 				palette.push_back({
-					file.Read<byte>(i * 4 + 10 + 3) / 255.f,
-					file.Read<byte>(i * 4 + 10 + 2) / 255.f,
-					file.Read<byte>(i * 4 + 10 + 1) / 255.f,
-					file.Read<byte>(i * 4 + 10 + 0) / 255.f,
+					paletteData.Read<byte>(i * 4 + 3),
+					paletteData.Read<byte>(i * 4 + 2),
+					paletteData.Read<byte>(i * 4 + 1),
+					paletteData.Read<byte>(i * 4 + 0),
 				});
 
-			const byte compression = file.Read<byte>(10 + 4 * nPalette);
+			const byte compression = paletteData.Read<byte>(4 * nPalette);
 			enum CompressionFormat
 			{
 				NONE = 0,
 				RLE = 1
 			};
 
-			image.pixels = new glm::vec4[image.w * image.h];
+			const size_t pixelOffset = 10 + 4 * nPalette + 1;
+			const size_t pixelCount = (size_t)image.w * image.h;
+			image.pixels = new rgba8_t[pixelCount];
 			image.deletePixels = false;
 
 			switch (compression)
 			{
 			case NONE:
-				for (u32 y = 0; y < image.h; ++y)
-					for (u32 x = 0; x < image.w; ++x)
-					{
-						size_t index = y * image.w + x;
-						image.pixels[index] = palette[file.Read<byte>(10 + 4 * nPalette + 1 + index)];
-					}
+				if (const cursor_t indices = file.At(pixelOffset, pixelCount))
+				{
+					for (size_t index = 0; index < pixelCount; ++index)
+						image.pixels[index] = palette[indices.Read<byte>(index)];
+				}
 				break;
 
 			case RLE:
 			{
-				const u32 len = file.Read<u32>(10 + 4 * nPalette + 1, true);
+				const cursor_t lenData = file.At(pixelOffset, 4);
+				const u32 len = lenData ? lenData.Read<u32>(0) : 0;
+				const cursor_t entries = file.At(pixelOffset + 4, len);
+				if (!entries)
+					break;
+
 				u32 index = 0;
 				int count = 0;
 				byte pid = 0;
 				for(u32 entryIndex = 0; entryIndex < len / 2; ++entryIndex)
 				{
-					count = file.Read<byte>(0);
-					pid = file.Read<byte>(1, true);
-					for (int i = 0; i < count; ++i)
+					count = entries.Read<byte>(entryIndex * 2 + 0);
+					pid = entries.Read<byte>(entryIndex * 2 + 1);
+					for (int i = 0; i < count && index < pixelCount; ++i)
 					{
-#pragma warning(suppress: 6386) // No real buffer overrun
 						image.pixels[index++] = palette[pid];
 					}
 				}
@@ -1205,30 +1395,23 @@ void LoadCustomImages()
 			file.Close();
 		}
 	}
+	return customImages;
 }
 
-bool GetTextureInformation(const std::string& filepath, ImagePacker::ImageInformationList& list)
+const std::vector<texture_t>& GetCustomImages()
 {
-	file_t f;
-	if (ReadFile(filepath, f))
-	{
-		u32 nFiles = f.Read<u32>(0, true);
-		for (u32 i = 0; i < nFiles; ++i)
-		{
-			GrLOD_t lod = f.Read<GrLOD_t>(sizeof(GrLOD_t), true);
-			GrAspectRatio_t asp = f.Read<GrAspectRatio_t>(0, true);
-			// Skip data
-			(void)f.Read<u32>(f.Read<u32>(0x7C, true) - 4, true);
+	// Thread safe initialisation, whichever load gets here first decodes them
+	static const std::vector<texture_t> customImages = LoadCustomImages();
+	return customImages;
+}
 
-			auto [w, h] = GetImageSizeFromTexture(lod, asp);
-			list.push_back({ (int)w, (int)h, (void*)i });
-		}
-		LoadCustomImages();
-		for(size_t i = 0; i < customImages.size(); ++i)
-			list.push_back({ (int)customImages[i].w, (int)customImages[i].h, (void*)(ECustomImageType::CUSTOM_IMAGE_BASE + i)});
-		return true;
-	}
-	return false;
+void GetTextureInformation(const std::vector<vfxentry_t>& index, ImagePacker::ImageInformationList& list, const std::vector<texture_t>& customImages)
+{
+	for (size_t i = 0; i < index.size(); ++i)
+		if (index[i].sharesWith < 0)
+			list.push_back({ (int)index[i].w, (int)index[i].h, (void*)i });
+	for(size_t i = 0; i < customImages.size(); ++i)
+		list.push_back({ (int)customImages[i].w, (int)customImages[i].h, (void*)(ECustomImageType::CUSTOM_IMAGE_BASE + i)});
 }
 
 std::string GetLevelName(const std::string& levelStr, u32 dataOffsetRaw)
@@ -1367,56 +1550,115 @@ void ApplyPathModels(level_t& level)
 	}
 }
 
-bool LoadLevel(const std::string& filepath, level_t& level)
+// Writes the sheet to the cache once every texture in it has been decoded, unless it came from there
+void CacheAtlas(level_t& level, LoaderContext& loader)
 {
-	file_t dfx;
-	if (!ReadFile(filepath, dfx))
+	if (loader.atlasCached || !level.sheet.pixels)
+		return;
+	if (std::any_of(level.textures.begin(), level.textures.end(), [](const texture_t& t) { return t.x >= 0 && !t.decoded; }))
+		return;
+
+	loader.atlasCached = SaveCachedAtlas(loader.atlasKey, level);
+}
+
+bool GetSheetImageList(const std::string& vfxPath, ImagePacker::ImageInformationList& list)
+{
+	list.clear();
+	file_t vfx;
+	std::vector<vfxentry_t> index;
+	if (!ReadFile(vfxPath, vfx, EFileAccess::Sequential) || !IndexVFX(vfx, index))
 		return false;
+	GetTextureInformation(index, list, GetCustomImages());
+	return true;
+}
 
-	levelext_t levelData;
+int GetSheetPadding()
+{
+	return c_SHEETPADDING;
+}
 
-	const std::string vfxPath = filepath.substr(0, filepath.find_last_of(".")) + ".vfx";
+// Texture pipeline: VFX index, packing, then decoding into the sheet (unless lazyTextures is set).
+// A cached sheet for the same VFX replaces the packing and decoding.
+// Only touches level.list, level.sheet, level.textures and the VFX fields of the loader.
+void LoadTextureSheet(const std::string& vfxPath, level_t& level, LoaderContext& loader, bool lazyTextures, const std::stop_token& stop)
+{
 	if (level.sheet.pixels)
 	{
 		delete[] level.sheet.pixels;
 		level.sheet.pixels = NULL;
 	}
 	level.list.clear();
-	if (GetTextureInformation(vfxPath, level.list))
+	// Mapped and walked once, packing and decoding both work from the index
+	file_t& vfx = loader.vfx;
+	ReadFile(vfxPath, vfx, EFileAccess::Sequential);
+	if (IndexVFX(vfx, loader.vfxIndex))
 	{
-		if (int size = ImagePacker::GeneratePackedList(level.list, 256); size != 0)
+		// Same VFX as last time, nothing to pack or decode
+		loader.atlasKey = GetAtlasCacheKey(vfx, loader.customImages, c_SHEETPADDING, c_SHEETPACKING);
+		if (LoadCachedAtlas(loader.atlasKey, level, loader.vfxIndex.size() + loader.customImages.size()))
+		{
+			// The cutouts of the level that wrote the cache, decoded again once this level's are known
+			for (auto& texture : level.textures)
+				if (texture.x >= 0 && !texture.decoded && texture.sharesWith < 0)
+					FillCheckerboard(level.sheet, texture.x, texture.y, texture.w, texture.h);
+			printf("Sheet loaded from the cache at %ux%u\n", level.sheet.w, level.sheet.h);
+			loader.atlasCached = true;
+			return;
+		}
+
+		GetTextureInformation(loader.vfxIndex, level.list, loader.customImages);
+		if (int size = ImagePacker::GeneratePackedList(level.list, 256, c_SHEETPADDING, c_SHEETPACKING); size != 0)
 		{
 			printf("Sheet generated at %dx%d\n", size, size);
-			level.sheet = { (unsigned int)size, (unsigned int)size, new glm::vec4[size * size] };
+
+			size_t shared = 0, savedArea = 0;
+			for (auto& entry : loader.vfxIndex)
+			{
+				if (entry.sharesWith < 0)
+					continue;
+				++shared;
+				savedArea += (entry.w + 2 * c_SHEETPADDING) * (entry.h + 2 * c_SHEETPADDING);
+			}
+			if (shared != 0)
+				printf("%zu duplicate textures share a rectangle, saving %zu texels (%.1f%% of the sheet)\n", shared, savedArea, 100.0 * savedArea / ((size_t)size * size));
+			level.sheet = { (unsigned int)size, (unsigned int)size, new rgba8_t[size * size] };
 			if (level.sheet.pixels)
 			{
-				for (int y = 0; y < size; ++y)
-				{
-					for (int x = 0; x < size; ++x)
-					{
-						if (((x % 128) == (x % 64) && (y % 128) == (y % 64)) || ((x % 128) != (x % 64) && (y % 128) != (y % 64)))
-							level.sheet.pixels[x + y * size] = { 1, 0, 1, 1 };
-						else
-							level.sheet.pixels[x + y * size] = { 0.5, 0, 0.5, 1 };
-					}
-				}
-				LoadTextures(vfxPath, level);
+				// Textures that are never decoded keep showing the checkers
+				if (lazyTextures)
+					FillCheckerboard(level.sheet, 0, 0, size, size);
+				else
+					FillUnusedSheet(level.sheet, level.list);
+				LoadTextures(vfx, loader.vfxIndex, level, loader.customImages, !lazyTextures, stop);
 			}
 		}
 	}
+}
 
-	dfx.baseOffset = level.baseData = ((dfx.Read<u32>(0) + 0x200) >> 9) << 11;
-	
-	levelData.modelAddress = dfx.Read<addr_t>(0x3C);
-	levelData.nObjects = dfx.Read<u32>(0x78);
-	levelData.objAddress = dfx.Read<addr_t>(0x7C);
-	levelData.nSkybox = dfx.Read<u32>(0x20);
-	levelData.skyboxAddress = dfx.Read<u32>(0x24);
-	level.bgColor[0] = dfx.Read<byte>(68) / 255.f;
-	level.bgColor[1] = dfx.Read<byte>(69) / 255.f;
-	level.bgColor[2] = dfx.Read<byte>(70) / 255.f;
+// Geometry pipeline: DFX header, level geometry, models and instances.
+// Leaves the texture fields of the level alone, so it can run alongside LoadTextureSheet.
+bool ReadLevel(file_t& dfx, level_t& level, levelext_t& levelData, bool lazyObjects, const std::stop_token& stop)
+{
+	const cursor_t fileHeader = dfx.At(0, 0x10C);
+	if (!fileHeader)
+		return false;
 
-	ReadLevelGeometry(dfx, level, levelData, dfx.Read<addr_t>(0));
+	dfx.baseOffset = level.baseData = ((fileHeader.Read<u32>(0) + 0x200) >> 9) << 11;
+	const cursor_t header = dfx.At(0, 0x80);
+	if (!header)
+		return false;
+	
+	levelData.modelAddress = header.Read<addr_t>(0x3C);
+	levelData.nObjects = header.Read<u32>(0x78);
+	levelData.objAddress = header.Read<addr_t>(0x7C);
+	levelData.nSkybox = header.Read<u32>(0x20);
+	levelData.skyboxAddress = header.Read<u32>(0x24);
+	level.bgColor[0] = header.Read<byte>(68) / 255.f;
+	level.bgColor[1] = header.Read<byte>(69) / 255.f;
+	level.bgColor[2] = header.Read<byte>(70) / 255.f;
+
+	if (!ReadLevelGeometry(dfx, level, levelData, header.Read<addr_t>(0)))
+		return false;
 
 	std::shared_ptr<Model> misc = std::make_shared<Model>(0);
 	CreateSpriteObject(level, misc, "@Path", ECustomImageType::INFO_UNKNOWN, 1);
@@ -1427,23 +1669,65 @@ bool LoadLevel(const std::string& filepath, level_t& level)
 	CreateSpriteObject(level, spawn, "$Spawn", ECustomImageType::INFO_SPAWN);
 	level.models.push_back(spawn);
 	spawn->instances.push_back({});
-	spawn->instances[0].position = { dfx.Read<i16>(0x28) * -0.001f, dfx.Read<i16>(0x2C) * -0.001f, dfx.Read<i16>(0x2A) * 0.001f };
+	spawn->instances[0].position = { header.Read<i16>(0x28) * -0.001f, header.Read<i16>(0x2C) * -0.001f, header.Read<i16>(0x2A) * 0.001f };
 
 	size_t currModelIndex = level.models.size();
 
+	// Instances can refer to the models created above (a model address of 0 is a bare path)
+	for (u32 i = 0; i < level.models.size(); ++i)
+		levelData.modelIndices.try_emplace(level.models[i]->addr, i);
+
+	// Pre-scan the instance table for the models it uses, in order of first use
+	for (u32 i = 0; i < levelData.nObjects; ++i)
+	{
+		const cursor_t instance = DFX::InstanceRecord::Table(dfx, levelData.objAddress + 0x30 * i, 1);
+		if (!instance)
+			continue;
+
+		const addr_t modelAddr = std::get<0>(DFX::InstanceRecord::Unpack(instance, 0));
+		if (levelData.modelIndices.try_emplace(modelAddr, (u32)level.models.size()).second)
+			ReadObjectGeometry(dfx, level, levelData, modelAddr);
+	}
+
 	for (u32 i = 0; i < levelData.nObjects; ++i)
 	{
+		if (stop.stop_requested())
+			return false;
 		ReadObjectInstance(dfx, level, levelData, levelData.objAddress + 0x30 * i);
 	}
 
+	if (!lazyObjects)
+	{
+		std::vector<std::shared_ptr<Model>> pending;
+		for (auto& mdl : level.models)
+			if (mdl->geometryPending)
+				pending.push_back(mdl);
+
+		// One context per thread, each with its own material cache and cutout queue, so the threads
+		// share nothing and a material is decoded at most once per thread. The models were already
+		// put in level.models above, which keeps the order fixed.
+		const size_t threadCount = std::min(pending.size(), ThreadPool::Get().GetThreadCount());
+		std::vector<levelext_t> contexts(threadCount);
+		ThreadPool::Get().ParallelFor(threadCount, [&](size_t t)
+			{
+				for (size_t i = t; i < pending.size() && !stop.stop_requested(); i += threadCount)
+					ReadModelGeometry(dfx, level, contexts[t], pending[i]);
+			});
+
+		if (stop.stop_requested())
+			return false;
+
+		for (auto& context : contexts)
+			levelData.materialsToFix.merge(context.materialsToFix);
+	}
+
 	// By treating the level as a model, we need to give it an instance
 	level.models[0]->instances.push_back({});
 
-	dfx.baseOffset = 0;
 	std::string s;
 	s.resize(8);
-	memcpy(s.data(), dfx.ptrAt<char>(0xE0), 8);
-	level.name = GetLevelName(s, dfx.Read<u32>(0));
+	memcpy(s.data(), fileHeader.ptr<char>(0xE0), 8);
+	level.name = GetLevelName(s, fileHeader.Read<u32>(0));
 
 	ApplyPathModels(level);
 
@@ -1451,55 +1735,171 @@ bool LoadLevel(const std::string& filepath, level_t& level)
 		{
 			return a->name < b->name;
 		});
+	// The indices point at the unsorted models, and nothing after the instances needs them anyway
+	levelData.modelIndices.clear();
 
-	memcpy(level.pickupName[0], dfx.ptrAt<char>(0xEC), 8);
-	memcpy(level.pickupName[1], dfx.ptrAt<char>(0xF8), 8);
-	memcpy(level.pickupName[2], dfx.ptrAt<char>(0x104), 8);
+	memcpy(level.pickupName[0], fileHeader.ptr<char>(0xEC), 8);
+	memcpy(level.pickupName[1], fileHeader.ptr<char>(0xF8), 8);
+	memcpy(level.pickupName[2], fileHeader.ptr<char>(0x104), 8);
 	level.pickupName[0][8] = level.pickupName[1][8] = level.pickupName[2][8] = '\0';
 
-	// Apply object UVs
-	for(auto& mdl : level.models)
-		for(auto& poly : mdl->polygons)
-			if (auto info = FindImageInfoById(level.list, poly.materialID))
-			{
-				//auto& poly = mdl->polygons[i];
-				for (int j = 0; j < 3; ++j)
-				{
-					poly.uvs[j].x *= info->width;
-					poly.uvs[j].y *= info->height;
-					poly.uvs[j].x += info->x;
-					poly.uvs[j].y += info->y;
-					poly.uvs[j].x /= (float)level.sheet.w;
-					poly.uvs[j].y /= (float)level.sheet.h;
-				}
-			}
+	return true;
+}
 
-	for (auto mat : materialsToFix)
-	{
-		if (mat >= level.textures.size() || !level.textures[mat].argb1555)
-			continue;
+LoadTask LoadLevelStaged(std::string filepath, level_t& level, bool lazyObjects, bool lazyTextures, std::stop_token stop)
+{
+	level.loader.reset();
+	auto loader = std::make_shared<LoaderContext>();
+	file_t& dfx = loader->dfx;
+	if (!ReadFile(filepath, dfx))
+		co_return false;
+
+	levelext_t& levelData = loader->levelData;
+	const std::string vfxPath = filepath.substr(0, filepath.find_last_of(".")) + ".vfx";
 
-		if (auto info = FindImageInfoById(level.list, mat))
+	co_yield ELoadStage::Decoding;
+
+	// Textures and geometry don't depend on each other until the UVs are mapped into the sheet
+	bool geometryRead = false;
+	ThreadPool::Get().ParallelFor(2, [&](size_t i)
 		{
-			for (int y = 0; y < info->height; ++y)
-			{
-				for (int x = 0; x < info->width; ++x)
-				{
-					auto& p = level.sheet.pixels[level.sheet.w * (y + info->y) + x + info->x];
-					if (p.r < (1 / 256.f) && p.g < (1 / 256.f) && p.b < (1 / 256.f))
-						p.a = 0.f;
-					//p.g = 0.f;
-					//p.r = p.b = 255.f;
-				}
-			}
-			//BlitTex(level.sheet, level.textures[mat], info->x, info->y);
-		}
+			if (i == 0)
+				LoadTextureSheet(vfxPath, level, *loader, lazyTextures, stop);
+			else
+				geometryRead = ReadLevel(dfx, level, levelData, lazyObjects, stop);
+		});
+
+	if (!geometryRead || stop.stop_requested())
+		co_return false;
+
+	co_yield ELoadStage::Mapping;
+
+	std::vector<unsigned int> ids;
+	for (auto& mdl : level.models)
+		ReferenceTextures(level, *mdl, ids);
+	printf("%zu of %zu textures referenced\n", ids.size(), loader->vfxIndex.size());
+	MarkCutouts(level, levelData.materialsToFix, ids);
+	if (!lazyTextures)
+	{
+		// Everything the texture pipeline left for now, which is the ARGB1555 textures
+		ids.resize(loader->vfxIndex.size());
+		std::iota(ids.begin(), ids.end(), 0);
 	}
-	materialsToFix.clear();
+	DecodeTextures(loader->vfx, loader->vfxIndex, level, ids, stop);
+	if (stop.stop_requested())
+		co_return false;
+
+	BuildSheetMips(level);
+	CacheAtlas(level, *loader);
+
+	if (lazyObjects || lazyTextures)
+		level.loader = loader;
+
+	co_return true;
+}
+
+bool LoadLevel(const std::string& filepath, level_t& level, bool lazyObjects, bool lazyTextures)
+{
+	LoadTask task = LoadLevelStaged(filepath, level, lazyObjects, lazyTextures);
+	while (task.Resume())
+		;
+	return task.GetResult();
+}
+
+void FreeLevel(level_t& level)
+{
+	for (auto& tex : level.textures)
+		if (tex.deletePixels)
+			delete[] tex.pixels;
+	level.textures.clear();
+	delete[] level.sheet.pixels;
+	level.sheet = { 0, 0, NULL };
+	for (auto& mip : level.sheetMips)
+		delete[] mip.pixels;
+	level.sheetMips.clear();
+	level.list.clear();
+	level.models.clear();
+	level.paths.clear();
+	level.loader.reset();
+}
+
+bool LoadModelGeometry(level_t& level, std::shared_ptr<Model> model, std::vector<sheetrect_t>* changed)
+{
+	if (!model->geometryPending || !level.loader)
+		return false;
 
+	file_t& dfx = level.loader->dfx;
+	levelext_t& levelData = level.loader->levelData;
+	ReadModelGeometry(dfx, level, levelData, model);
+
+	// Textures are only decoded here if the load left them out too, or if they turn out to be cutouts
+	// after they were decoded without it
+	std::vector<unsigned int> referenced;
+	ReferenceTextures(level, *model, referenced);
+	MarkCutouts(level, levelData.materialsToFix, referenced);
+	const bool sheetChanged = DecodeTextures(level.loader->vfx, level.loader->vfxIndex, level, referenced, {}, changed);
+	if (sheetChanged)
+		BuildSheetMips(level);
+	return sheetChanged;
+}
+
+bool LoadAllTextures(level_t& level)
+{
+	if (!level.loader)
+		return false;
+
+	std::vector<unsigned int> ids(level.loader->vfxIndex.size());
+	for (unsigned int i = 0; i < ids.size(); ++i)
+		ids[i] = i;
+	if (!DecodeTextures(level.loader->vfx, level.loader->vfxIndex, level, ids))
+		return false;
+
+	BuildSheetMips(level);
+	CacheAtlas(level, *level.loader);
 	return true;
 }
 
+int GetMaterialSlot(const level_t& level, unsigned int materialID)
+{
+	// VFX textures first, then the custom images, same as level.textures
+	const size_t nCustom = std::min(GetCustomImages().size(), level.textures.size());
+	const size_t nVFX = level.textures.size() - nCustom;
+	if (materialID < nVFX)
+		return (int)materialID;
+	if (materialID >= ECustomImageType::CUSTOM_IMAGE_BASE && materialID - ECustomImageType::CUSTOM_IMAGE_BASE < nCustom)
+		return (int)(nVFX + materialID - ECustomImageType::CUSTOM_IMAGE_BASE);
+	return -1;
+}
+
+std::vector<glm::vec4> GetMaterialRects(const level_t& level)
+{
+	std::vector<glm::vec4> rects(level.textures.size(), glm::vec4(0, 0, 1, 1));
+	if (level.sheet.w == 0 || level.sheet.h == 0)
+		return rects;
+
+	const float sw = (float)level.sheet.w, sh = (float)level.sheet.h;
+	for (size_t i = 0; i < level.textures.size(); ++i)
+	{
+		const texture_t& texture = level.textures[i];
+		if (texture.x >= 0)
+			rects[i] = { texture.x / sw, texture.y / sh, texture.w / sw, texture.h / sh };
+	}
+	return rects;
+}
+
+glm::vec2 GetAtlasUV(const level_t& level, unsigned int materialID, glm::vec2 uv)
+{
+	const int slot = GetMaterialSlot(level, materialID);
+	if (slot < 0 || level.textures[slot].x < 0 || level.sheet.w == 0 || level.sheet.h == 0)
+		return uv;
+
+	const texture_t& texture = level.textures[slot];
+	return {
+		(texture.x + uv.x * texture.w) / (float)level.sheet.w,
+		(texture.y + uv.y * texture.h) / (float)level.sheet.h
+	};
+}
+
 void PathComponent::ParseData(file_t& file, level_t& level, unsigned int data)
 {
 	ReadMovingPlatform(file, level, data, data);
@@ -1507,18 +1907,20 @@ void PathComponent::ParseData(file_t& file, level_t& level, unsigned int data)
 
 void LevelTVComponent::ParseData(file_t& file, level_t& level, unsigned int data)
 {
-	file.seek(data);
-	screenType = file.Read<byte>(0);
-	levelNum = file.Read<byte>(2);
-	strncpy_s(levelType, file.ptr<char>() + 4, strnlen(file.ptr<char>() + 4, 8));
-	file.pop();
+	const cursor_t tv = file.At(data, 12);
+	if (!tv)
+		return;
+
+	screenType = tv.Read<byte>(0);
+	levelNum = tv.Read<byte>(2);
+	strncpy_s(levelType, tv.ptr<char>(4), strnlen(tv.ptr<char>(4), 8));
 }
 
 void LevelTVComponent::RenderGUI(level_t& level, void* textureSheet)
 {
 	ImGui::Text("Level ID: %s%d", levelType, levelNum);
 
-	if (auto info = FindImageInfoById(level.list, 200 + screenType))
+	if (auto info = FindTextureRect(level, 200 + screenType))
 	{
 		ImGui::SameLine();
 		ImGui::Image(textureSheet, { 16, 16 },
@@ -1532,8 +1934,10 @@ void FlyBoxComponent::ParseData(file_t& file, level_t& level, unsigned int data)
 {
 	if (data == 0)
 		flyBoxType = 0;
+	else if (const cursor_t flyBox = file.At(data, 1))
+		flyBoxType = flyBox.Read<byte>(0);
 	else
-		flyBoxType = file.ReadAt<byte>(data);
+		flyBoxType = 0;
 }
 
 void FlyBoxComponent::RenderGUI(level_t& level, void* textureSheet)
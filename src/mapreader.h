@@ -1,20 +1,24 @@
 #pragma once
 #include <string>
 #include <vector>
+#include <algorithm>
 #include <memory>
 #include <glm/vec3.hpp>
 #include <glm/vec2.hpp>
 #include <glm/vec4.hpp>
 #include "imagepacker.h"
+#include "loadtask.h"
+#include <stop_token>
 
 #include <sstream>
 
 struct file_t;
 struct level_t;
+struct LoaderContext;
 
 struct IComponent
 {
-	~IComponent() = default;
+	virtual ~IComponent() = default;
 
 	virtual void ParseData(file_t& file, level_t& level, unsigned int data) = 0;
 	virtual void ExportData(std::stringstream& ss) = 0;
@@ -137,7 +141,7 @@ struct Model
 		size_t vertex[3];
 		unsigned int materialID;
 		unsigned short flags;
-		glm::vec2 uvs[3];
+		glm::vec2 uvs[3]; // Relative to the polygon's texture, GetAtlasUV maps them into the sheet
 		unsigned char optColors[4] = { 0, 0, 0, 0 };
 	};
 	const unsigned int addr;
@@ -148,16 +152,43 @@ struct Model
 	bool objectVisibility = true;
 	bool showInstances = false;
 	bool hasNoTextures = false;
+	bool geometryPending = false; // Vertices and polygons not read yet, see LoadModelGeometry
 
 	Model(unsigned int addr) : addr(addr) {}
 };
 
+// Texel as it is stored in the sheet and uploaded, 8 bits per channel
+struct rgba8_t
+{
+	unsigned char r, g, b, a;
+};
+
+// What a texture's alpha channel holds, worked out when it's decoded
+enum class ETextureAlpha
+{
+	Opaque,     // Every texel is fully opaque
+	Cutout,     // Texels are either fully opaque or fully transparent
+	Translucent // Some texels are in between
+};
+
 struct texture_t
 {
 	unsigned int w, h;
-	glm::vec4* pixels;
+	rgba8_t* pixels;
 	bool deletePixels = true;
 	bool argb1555 = false;
+	int x = -1, y = -1; // Rectangle in level_t::sheet, -1 if it isn't in it
+	bool decoded = false;    // The rectangle holds the texels, not the placeholder checkers
+	bool referenced = false; // Used by a polygon of a model that has been read
+	bool cutout = false;     // ARGB1555 texture used by a material that wants its black texels transparent
+	ETextureAlpha alpha = ETextureAlpha::Opaque;
+	int sharesWith = -1;     // Earlier texture with the same contents, whose rectangle and decode this one uses
+};
+
+// Part of the sheet in texels, x1 and y1 excluded
+struct sheetrect_t
+{
+	int x0, y0, x1, y1;
 };
 
 struct level_t
@@ -167,13 +198,53 @@ struct level_t
 	std::vector<Path> paths;
 	ImagePacker::ImageInformationList list;
 	texture_t sheet{ 0, 0, NULL };
+	std::vector<texture_t> sheetMips; // Levels 1 and up of the sheet, kept in sync with it by the loader
 	std::string name;
 	float bgColor[3];
 	char pickupName[3][9];
 	unsigned int baseData;
+	std::shared_ptr<LoaderContext> loader; // Only set when object geometry or textures were deferred
 };
 
-bool LoadLevel(const std::string& filepath, level_t& level);
+// With lazyObjects, object models only get their header read here and the rest is left to LoadModelGeometry.
+// With lazyTextures, the sheet is laid out for every texture but only the ones used by the geometry read so
+// far get decoded, LoadModelGeometry and LoadAllTextures decode the rest when they are needed.
+// All loader state is per call, so different levels can be loaded from different threads at the same time.
+bool LoadLevel(const std::string& filepath, level_t& level, bool lazyObjects = false, bool lazyTextures = false);
+
+// Same as LoadLevel, but run one stage per Resume. The load also checks stop between textures and
+// objects, after a stop request it finishes early with a partial level that should be freed.
+LoadTask LoadLevelStaged(std::string filepath, level_t& level, bool lazyObjects = false, bool lazyTextures = false, std::stop_token stop = {});
+
+// Frees everything LoadLevel allocated for the level and empties it
+void FreeLevel(level_t& level);
+
+// Reads the vertices and polygons of a model deferred by LoadLevel, does nothing for any other model.
+// Returns true if the texture sheet was changed and has to be uploaded again. The parts of the sheet
+// that changed are added to changed, the mips changed under them too.
+bool LoadModelGeometry(level_t& level, std::shared_ptr<Model> model, std::vector<sheetrect_t>* changed = nullptr);
+
+// Decodes every texture LoadLevel left out, for whatever needs the whole sheet (the atlas view, exporting it).
+// Returns true if the texture sheet was changed and has to be uploaded again.
+bool LoadAllTextures(level_t& level);
+
+// Sizes of the textures and custom images LoadLevel packs into the sheet for the VFX, nothing placed yet.
+// For trying the packers on real levels without loading them, see tests/packer_benchmark.cpp.
+bool GetSheetImageList(const std::string& vfxPath, ImagePacker::ImageInformationList& list);
+
+// Border LoadLevel leaves around every image in the sheet
+int GetSheetPadding();
+
+// Index of a polygon's material in the GetMaterialRects table, -1 for untextured polygons
+int GetMaterialSlot(const level_t& level, unsigned int materialID);
+
+// Sheet rectangle (x, y, width, height in 0-1 sheet coordinates) of every material slot. Textures
+// that aren't in the sheet get the whole sheet, which leaves their UVs as they are. Only this changes
+// when the sheet is packed differently, the polygons' UVs never do.
+std::vector<glm::vec4> GetMaterialRects(const level_t& level);
+
+// Maps a polygon UV into the sheet, for whatever works with the sheet on the CPU (the exporters)
+glm::vec2 GetAtlasUV(const level_t& level, unsigned int materialID, glm::vec2 uv);
 
 inline std::string Hexify(unsigned int n)
 {
@@ -0,0 +1,228 @@
+#include "objectregistry.h"
+#include "mapreader.h"
+#include <unordered_map>
+#include <initializer_list>
+
+namespace
+{
+	template<typename T, int DataIndex>
+	void ParseComponent(file_t& file, level_t& level, objinstance_t& instance)
+	{
+		instance.AddComponent<T>().ParseData(file, level, instance.instanceData[DataIndex]);
+	}
+
+	using registry_t = std::unordered_map<uint64_t, objecttype_t>;
+
+	void Register(registry_t& registry, std::initializer_list<const char*> names, unsigned int flags, componentparser_t parser = nullptr)
+	{
+		for (const char* name : names)
+		{
+			objecttype_t& type = registry[PackObjectName(name)];
+			type.flags |= flags;
+			if (!parser)
+				continue;
+
+			for (auto& component : type.components)
+			{
+				if (!component)
+				{
+					component = parser;
+					break;
+				}
+			}
+		}
+	}
+
+	registry_t BuildRegistry()
+	{
+		registry_t registry;
+
+		// Objects that follow a path
+		Register(registry, {
+			"mplat___",
+			"flttblb_",
+			"flttbl__",
+			"finplat_",
+			"tbplat__",
+			"cart____",
+
+			"fltdesk_",
+			"fltchst_",
+
+			"tube____",
+			"tubegls_",
+
+			"kplat___",
+			"kplatb__",
+			"kplatc__",
+			"kplatd__",
+
+			"kswing__",
+			"kngdmnd_",
+			"const___",
+
+			"jimbloc_",
+			"jplat___",
+			"frocket_",
+			"jimboat_",
+			"logturn_",
+			"jimplts_",
+			"bldrgen_",
+
+			"flyplat_",
+			"jimplat_",
+
+			"qsauc___",
+			"rocket__",
+			"astplta_",
+			"darkshp_",
+
+			"darksop_",
+			"splat___",
+			"astpltb_",
+			"poop____", // why, these are just space platforms
+			"poopqq__",
+			"poopz___",
+			"qplat___",
+			"qsmall__",
+
+			"qelev___",
+			"qpad____",
+			"qdoor___",
+			"qbars___",
+			"qsdoor__",
+			"qssdoor_",
+			"discoff_",
+			"lvltv___",
+			"jaw_____",
+
+			"aztcflr_",
+			"aztcwl__",
+			"aztcbs__",
+			"aztcbks_",
+			"trndor__",
+			"gengen__",
+			"rockplt_",
+
+			"bee_____",
+			"rzstart_",
+			"rzbrain_",
+			"follow__",
+			"node____",
+			"pulse___",
+			"mspider_",
+			"rebggen_",
+			"rezsoul_",
+			"choppa__",
+			"tankb___",
+
+			"hrblock_",
+			"hrswtch_",
+			"reza____",
+			"skel____",
+			"hhelev__",
+
+			"draga___",
+			"kbgen___",
+			"moo_____",
+			"shark___",
+
+			"blastx__",
+			"blasty__",
+			"tvgen___",
+			"tvgurny_",
+			"mutant__",
+			"scorp___",
+			"sewertp_",
+			"casdraw_",
+
+			"@Path",
+		}, 0, ParseComponent<PathComponent, 2>);
+
+		Register(registry, { "lvltv___" }, 0, ParseComponent<LevelTVComponent, 0>);
+		Register(registry, { "powertv_", "circitv_" }, 0, ParseComponent<FlyBoxComponent, 0>);
+
+		Register(registry, {
+			"nflame__",
+			"mflame__",
+
+			"charger_",
+			"steam___",
+
+			"cold____",
+
+			"proxsig_",
+			"@Path",
+
+			/// COLLECTIBLES
+			// Aztec 2 Step
+			"gem_____",
+
+			// I Got the Reruns
+			"coltv___",
+
+			// Trouble in Uranus
+			"saucer__",
+
+			// In Drag Net
+			"badge___",
+
+			// The Spy Who Loved Himself
+			"case____",
+
+			// Circuit Central
+			"batt____", // Chips and Dips
+			"led_____",
+			"atom____",
+
+			// Scream TV
+			"skull___", // Thursday the 12th
+			"tomb____",
+			"jason___",
+
+			// Kung-Fu Theatre
+			"takeout_", // Lizard in a China Shop
+			"yinyang_",
+			"kabuki__",
+
+			// Toon TV
+			"carrot__",
+			"spinach_",
+			"plunge__",
+
+			// Prehistory Channel
+			"drum____",
+			"cowhead_",
+			"dino____",
+
+			// Space Channel
+			"ship____",
+			"phaser__",
+			"robot___",
+
+			// Mazed and Confused (Rezop 1)
+			"cd______",
+			"radiate_", // Bugged Out
+			"camera__",
+
+			// No Weddings and a Funeral (Rezop 3)
+			"gear____",
+			"toolbox_",
+			"oilcan__",
+		}, OBJECT_BILLBOARD);
+
+		return registry;
+	}
+}
+
+const objecttype_t* FindObjectType(const std::string& name)
+{
+	static const registry_t registry = BuildRegistry();
+
+	const uint64_t packed = PackObjectName(name);
+	if (packed == 0)
+		return nullptr;
+
+	auto it = registry.find(packed);
+	return it != registry.end() ? &it->second : nullptr;
+}
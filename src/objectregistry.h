@@ -0,0 +1,40 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <cstdint>
+
+struct file_t;
+struct level_t;
+struct objinstance_t;
+
+// Object names are at most 8 characters, so they fit in (and are compared as) a single integer.
+// Returns 0 for names that are too long to be object names.
+constexpr uint64_t PackObjectName(std::string_view name)
+{
+	if (name.size() > 8)
+		return 0;
+
+	uint64_t packed = 0;
+	for (size_t i = 0; i < name.size(); ++i)
+		packed |= (uint64_t)(unsigned char)name[i] << (8 * i);
+	return packed;
+}
+
+enum EObjectFlags : unsigned int
+{
+	OBJECT_BILLBOARD = 1 << 0, // Always turned towards the camera
+};
+
+// Adds a component to the instance and parses it from one of the instance's data words
+using componentparser_t = void(*)(file_t& file, level_t& level, objinstance_t& instance);
+
+struct objecttype_t
+{
+	static constexpr size_t c_MAXCOMPONENTS = 2;
+
+	unsigned int flags = 0;
+	componentparser_t components[c_MAXCOMPONENTS] = {};
+};
+
+// Returns the registered type for an object name, or NULL if the object has nothing special about it
+const objecttype_t* FindObjectType(const std::string& name);
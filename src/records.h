@@ -0,0 +1,70 @@
+#pragma once
+#include "filereader.h"
+#include <tuple>
+
+// Compile time descriptions of fixed layout records.
+// A record lists its stride and fields once, everything else (bounds, offsets, the decode loops)
+// is generated from that so the parsers don't have to carry magic offsets around.
+
+// A single value of type T, Offset bytes into the record
+template<typename T, size_t Offset>
+struct field_t
+{
+	using type = T;
+	static constexpr size_t offset = Offset;
+	static constexpr size_t end = Offset + sizeof(T);
+};
+
+template<size_t Stride, typename... Fields>
+struct record_t
+{
+	static constexpr size_t stride = Stride;
+	static_assert(sizeof...(Fields) > 0, "Record needs at least one field");
+	static_assert(((Fields::end <= Stride) && ...), "Field lies outside of the record");
+
+	using values_t = std::tuple<typename Fields::type...>;
+
+	template<size_t I>
+	using field = std::tuple_element_t<I, std::tuple<Fields...>>;
+
+	// Validated view over count records starting at offset
+	static cursor_t Table(const file_t& file, size_t offset, size_t count)
+	{
+		return file.At(offset, count * Stride);
+	}
+
+	// All fields of record i as a tuple, meant for structured bindings
+	static values_t Unpack(const cursor_t& table, size_t i)
+	{
+		const unsigned char* record = table.data + i * Stride;
+		return { Load<Fields>(record)... };
+	}
+
+	// Calls fn(i, field0, field1, ...) for the first count records of the table
+	template<typename Fn>
+	static void ForEach(const cursor_t& table, size_t count, Fn&& fn)
+	{
+		const unsigned char* record = table.data;
+		for (size_t i = 0; i < count; ++i, record += Stride)
+			fn(i, Load<Fields>(record)...);
+	}
+
+	// Decodes count records straight into dst, field N going into the Nth member pointer
+	template<auto... Members, typename Dst>
+	static void DecodeInto(const cursor_t& table, size_t count, Dst* dst)
+	{
+		static_assert(sizeof...(Members) == sizeof...(Fields), "Need one member per field");
+		const unsigned char* record = table.data;
+		for (size_t i = 0; i < count; ++i, record += Stride)
+			((dst[i].*Members = Load<Fields>(record)), ...);
+	}
+
+private:
+	template<typename F>
+	static typename F::type Load(const unsigned char* record)
+	{
+		typename F::type value;
+		memcpy(&value, record + F::offset, sizeof(value));
+		return FromLittleEndian(value);
+	}
+};
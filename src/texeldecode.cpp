@@ -0,0 +1,253 @@
+#include "texeldecode.h"
+#include "dfxrecords.h"
+#include "cpufeatures.h"
+#include <cstring>
+
+#if defined(CPU_X86)
+#include <immintrin.h>
+#elif defined(CPU_NEON)
+#include <arm_neon.h>
+#endif
+
+// The SIMD kernels store whole texels as interleaved bytes
+static_assert(sizeof(rgba8_t) == 4);
+
+namespace
+{
+	void DecodeARGB4444Scalar(const unsigned char* src, size_t count, rgba8_t* dst)
+	{
+		const cursor_t texels{ src, count * 2 };
+		for (size_t i = 0; i < count; ++i)
+		{
+			const u16 pixel_data = texels.Read<u16>(i * 2);
+			dst[i] = {
+				(byte)(((pixel_data & 0x0F00) >> 8) * 0x11),
+				(byte)(((pixel_data & 0x00F0) >> 4) * 0x11),
+				(byte)(((pixel_data & 0x000F)) * 0x11),
+				(byte)(((pixel_data & 0xF000) >> 12) * 0x11)
+			};
+		}
+	}
+
+	// With cutout, black texels (all colour bits clear) get no alpha either
+	template<bool cutout>
+	void DecodeARGB1555Scalar(const unsigned char* src, size_t count, rgba8_t* dst)
+	{
+		const cursor_t texels{ src, count * 2 };
+		for (size_t i = 0; i < count; ++i)
+		{
+			const u16 pixel_data = texels.Read<u16>(i * 2);
+			const bool opaque = (pixel_data & 0x8000) && (!cutout || (pixel_data & 0x7FFF));
+			dst[i] = {
+				(byte)(((pixel_data >> 10) & 0x1F) * 0x08),
+				(byte)(((pixel_data >> 5) & 0x1F) * 0x08),
+				(byte)(((pixel_data) & 0x1F) * 0x8),
+				(byte)(opaque ? 0xFF : 0x00)
+			};
+		}
+	}
+
+#if defined(CPU_X86)
+	// All kernels build two vectors of 16 bit lanes, one holding r | b << 8 and one g | a << 8,
+	// so a byte interleave of the two gives r, g, b, a in memory order
+
+	TARGET_SSE2 void Expand4444SSE2(__m128i v, __m128i& rb, __m128i& ga)
+	{
+		const __m128i nibbles = _mm_set1_epi16(0x0F0F);
+		const __m128i br = _mm_and_si128(v, nibbles);                     // b | r << 8
+		ga = _mm_and_si128(_mm_srli_epi16(v, 4), nibbles);                // g | a << 8
+		const __m128i wide = _mm_or_si128(br, _mm_slli_epi16(br, 4));     // n * 0x11 per byte
+		rb = _mm_or_si128(_mm_slli_epi16(wide, 8), _mm_srli_epi16(wide, 8));
+		ga = _mm_or_si128(ga, _mm_slli_epi16(ga, 4));
+	}
+
+	template<bool cutout>
+	TARGET_SSE2 void Expand1555SSE2(__m128i v, __m128i& rb, __m128i& ga)
+	{
+		const __m128i top5 = _mm_set1_epi16(0xF8);
+		const __m128i r = _mm_and_si128(_mm_srli_epi16(v, 7), top5);
+		const __m128i g = _mm_and_si128(_mm_srli_epi16(v, 2), top5);
+		const __m128i b = _mm_and_si128(_mm_slli_epi16(v, 3), top5);
+		__m128i a = _mm_srai_epi16(v, 15); // 0xFFFF or 0
+		if (cutout)
+			a = _mm_andnot_si128(_mm_cmpeq_epi16(_mm_and_si128(v, _mm_set1_epi16(0x7FFF)), _mm_setzero_si128()), a);
+		rb = _mm_or_si128(r, _mm_slli_epi16(b, 8));
+		ga = _mm_or_si128(g, _mm_slli_epi16(a, 8));
+	}
+
+	template<void(*Expand)(__m128i, __m128i&, __m128i&), void(*Scalar)(const unsigned char*, size_t, rgba8_t*)>
+	TARGET_SSE2 void DecodeSSE2(const unsigned char* src, size_t count, rgba8_t* dst)
+	{
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			__m128i rb, ga;
+			Expand(_mm_loadu_si128((const __m128i*)(src + i * 2)), rb, ga);
+			_mm_storeu_si128((__m128i*)(dst + i), _mm_unpacklo_epi8(rb, ga));
+			_mm_storeu_si128((__m128i*)(dst + i + 4), _mm_unpackhi_epi8(rb, ga));
+		}
+
+		if (i < count)
+			Scalar(src + i * 2, count - i, dst + i);
+	}
+
+	TARGET_AVX2 void Expand4444AVX2(__m256i v, __m256i& rb, __m256i& ga)
+	{
+		const __m256i nibbles = _mm256_set1_epi16(0x0F0F);
+		const __m256i br = _mm256_and_si256(v, nibbles);
+		ga = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibbles);
+		const __m256i wide = _mm256_or_si256(br, _mm256_slli_epi16(br, 4));
+		rb = _mm256_or_si256(_mm256_slli_epi16(wide, 8), _mm256_srli_epi16(wide, 8));
+		ga = _mm256_or_si256(ga, _mm256_slli_epi16(ga, 4));
+	}
+
+	template<bool cutout>
+	TARGET_AVX2 void Expand1555AVX2(__m256i v, __m256i& rb, __m256i& ga)
+	{
+		const __m256i top5 = _mm256_set1_epi16(0xF8);
+		const __m256i r = _mm256_and_si256(_mm256_srli_epi16(v, 7), top5);
+		const __m256i g = _mm256_and_si256(_mm256_srli_epi16(v, 2), top5);
+		const __m256i b = _mm256_and_si256(_mm256_slli_epi16(v, 3), top5);
+		__m256i a = _mm256_srai_epi16(v, 15);
+		if (cutout)
+			a = _mm256_andnot_si256(_mm256_cmpeq_epi16(_mm256_and_si256(v, _mm256_set1_epi16(0x7FFF)), _mm256_setzero_si256()), a);
+		rb = _mm256_or_si256(r, _mm256_slli_epi16(b, 8));
+		ga = _mm256_or_si256(g, _mm256_slli_epi16(a, 8));
+	}
+
+	// 16 texels per iteration. The byte unpacks work per 128 bit lane, so the halves are put back
+	// in order before storing.
+	template<void(*Expand)(__m256i, __m256i&, __m256i&), void(*Tail)(const unsigned char*, size_t, rgba8_t*)>
+	TARGET_AVX2 void DecodeAVX2(const unsigned char* src, size_t count, rgba8_t* dst)
+	{
+		size_t i = 0;
+		for (; i + 16 <= count; i += 16)
+		{
+			__m256i rb, ga;
+			Expand(_mm256_loadu_si256((const __m256i*)(src + i * 2)), rb, ga);
+			const __m256i lo = _mm256_unpacklo_epi8(rb, ga); // texels 0-3, 8-11
+			const __m256i hi = _mm256_unpackhi_epi8(rb, ga); // texels 4-7, 12-15
+			_mm256_storeu_si256((__m256i*)(dst + i), _mm256_permute2x128_si256(lo, hi, 0x20));
+			_mm256_storeu_si256((__m256i*)(dst + i + 8), _mm256_permute2x128_si256(lo, hi, 0x31));
+		}
+
+		if (i < count)
+			Tail(src + i * 2, count - i, dst + i);
+	}
+
+	constexpr auto DecodeARGB4444SSE2 = DecodeSSE2<Expand4444SSE2, DecodeARGB4444Scalar>;
+	template<bool cutout>
+	constexpr auto DecodeARGB1555SSE2 = DecodeSSE2<Expand1555SSE2<cutout>, DecodeARGB1555Scalar<cutout>>;
+	constexpr auto DecodeARGB4444AVX2 = DecodeAVX2<Expand4444AVX2, DecodeARGB4444SSE2>;
+	template<bool cutout>
+	constexpr auto DecodeARGB1555AVX2 = DecodeAVX2<Expand1555AVX2<cutout>, DecodeARGB1555SSE2<cutout>>;
+#elif defined(CPU_NEON)
+	// vst4 does the interleave, so the channels are simply narrowed into separate registers
+	void DecodeARGB4444NEON(const unsigned char* src, size_t count, rgba8_t* dst)
+	{
+		const uint16x8_t nibble = vdupq_n_u16(0x0F);
+		const uint8x8_t replicate = vdup_n_u8(0x11);
+
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			const uint16x8_t v = vreinterpretq_u16_u8(vld1q_u8(src + i * 2));
+			uint8x8x4_t out;
+			out.val[0] = vmul_u8(vmovn_u16(vandq_u16(vshrq_n_u16(v, 8), nibble)), replicate);
+			out.val[1] = vmul_u8(vmovn_u16(vandq_u16(vshrq_n_u16(v, 4), nibble)), replicate);
+			out.val[2] = vmul_u8(vmovn_u16(vandq_u16(v, nibble)), replicate);
+			out.val[3] = vmul_u8(vmovn_u16(vshrq_n_u16(v, 12)), replicate);
+			vst4_u8((uint8_t*)(dst + i), out);
+		}
+
+		if (i < count)
+			DecodeARGB4444Scalar(src + i * 2, count - i, dst + i);
+	}
+
+	template<bool cutout>
+	void DecodeARGB1555NEON(const unsigned char* src, size_t count, rgba8_t* dst)
+	{
+		const uint16x8_t top5 = vdupq_n_u16(0xF8);
+		const uint16x8_t colour = vdupq_n_u16(0x7FFF);
+
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			const uint16x8_t v = vreinterpretq_u16_u8(vld1q_u8(src + i * 2));
+			uint8x8x4_t out;
+			out.val[0] = vmovn_u16(vandq_u16(vshrq_n_u16(v, 7), top5));
+			out.val[1] = vmovn_u16(vandq_u16(vshrq_n_u16(v, 2), top5));
+			out.val[2] = vmovn_u16(vandq_u16(vshlq_n_u16(v, 3), top5));
+			uint16x8_t a = vreinterpretq_u16_s16(vshrq_n_s16(vreinterpretq_s16_u16(v), 15));
+			if (cutout)
+				a = vbicq_u16(a, vceqq_u16(vandq_u16(v, colour), vdupq_n_u16(0)));
+			out.val[3] = vmovn_u16(a);
+			vst4_u8((uint8_t*)(dst + i), out);
+		}
+
+		if (i < count)
+			DecodeARGB1555Scalar<cutout>(src + i * 2, count - i, dst + i);
+	}
+#endif
+
+	decodetexels_t SelectKernel(decodetexels_t avx2, decodetexels_t sse2, decodetexels_t neon, decodetexels_t scalar)
+	{
+		if (avx2 && CPU::HasAVX2())
+			return avx2;
+		if (sse2 && CPU::HasSSE2())
+			return sse2;
+		if (neon && CPU::HasNEON())
+			return neon;
+		return scalar;
+	}
+}
+
+void DecodeARGB4444(const unsigned char* src, size_t count, rgba8_t* dst)
+{
+#if defined(CPU_X86)
+	static const decodetexels_t kernel = SelectKernel(DecodeARGB4444AVX2, DecodeARGB4444SSE2, nullptr, DecodeARGB4444Scalar);
+#elif defined(CPU_NEON)
+	static const decodetexels_t kernel = SelectKernel(nullptr, nullptr, DecodeARGB4444NEON, DecodeARGB4444Scalar);
+#else
+	static const decodetexels_t kernel = DecodeARGB4444Scalar;
+#endif
+	kernel(src, count, dst);
+}
+
+void DecodeARGB1555(const unsigned char* src, size_t count, rgba8_t* dst)
+{
+#if defined(CPU_X86)
+	static const decodetexels_t kernel = SelectKernel(DecodeARGB1555AVX2<false>, DecodeARGB1555SSE2<false>, nullptr, DecodeARGB1555Scalar<false>);
+#elif defined(CPU_NEON)
+	static const decodetexels_t kernel = SelectKernel(nullptr, nullptr, DecodeARGB1555NEON<false>, DecodeARGB1555Scalar<false>);
+#else
+	static const decodetexels_t kernel = DecodeARGB1555Scalar<false>;
+#endif
+	kernel(src, count, dst);
+}
+
+void DecodeARGB1555Cutout(const unsigned char* src, size_t count, rgba8_t* dst)
+{
+#if defined(CPU_X86)
+	static const decodetexels_t kernel = SelectKernel(DecodeARGB1555AVX2<true>, DecodeARGB1555SSE2<true>, nullptr, DecodeARGB1555Scalar<true>);
+#elif defined(CPU_NEON)
+	static const decodetexels_t kernel = SelectKernel(nullptr, nullptr, DecodeARGB1555NEON<true>, DecodeARGB1555Scalar<true>);
+#else
+	static const decodetexels_t kernel = DecodeARGB1555Scalar<true>;
+#endif
+	kernel(src, count, dst);
+}
+
+std::vector<texelkernels_t> GetTexelKernels()
+{
+	std::vector<texelkernels_t> kernels = {
+		{ "Scalar", true, DecodeARGB4444Scalar, DecodeARGB1555Scalar<false>, DecodeARGB1555Scalar<true> }
+	};
+#if defined(CPU_X86)
+	kernels.push_back({ "SSE2", CPU::HasSSE2(), DecodeARGB4444SSE2, DecodeARGB1555SSE2<false>, DecodeARGB1555SSE2<true> });
+	kernels.push_back({ "AVX2", CPU::HasAVX2(), DecodeARGB4444AVX2, DecodeARGB1555AVX2<false>, DecodeARGB1555AVX2<true> });
+#elif defined(CPU_NEON)
+	kernels.push_back({ "NEON", CPU::HasNEON(), DecodeARGB4444NEON, DecodeARGB1555NEON<false>, DecodeARGB1555NEON<true> });
+#endif
+	return kernels;
+}
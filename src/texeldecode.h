@@ -0,0 +1,29 @@
+#pragma once
+#include "mapreader.h"
+#include <vector>
+
+// Expands count packed 16 bit Glide texels (little endian) into dst, 4 bits per channel
+// replicated into 8 (GR_TEXFMT_ARGB_4444)
+void DecodeARGB4444(const unsigned char* src, size_t count, rgba8_t* dst);
+
+// Same for GR_TEXFMT_ARGB_1555, colour channels are shifted up by 3 and alpha is either 0 or 255
+void DecodeARGB1555(const unsigned char* src, size_t count, rgba8_t* dst);
+
+// Same again, but black texels (no colour bits set) are transparent too. Used for the textures of
+// materials that ask for it.
+void DecodeARGB1555Cutout(const unsigned char* src, size_t count, rgba8_t* dst);
+
+using decodetexels_t = void(*)(const unsigned char* src, size_t count, rgba8_t* dst);
+
+// One implementation of all three converters. The ones above pick the fastest the CPU supports.
+struct texelkernels_t
+{
+	const char* name;
+	bool supported; // The CPU can run them
+	decodetexels_t argb4444;
+	decodetexels_t argb1555;
+	decodetexels_t argb1555Cutout;
+};
+
+// Every implementation built for this CPU family, scalar reference first. Only there for the tests.
+std::vector<texelkernels_t> GetTexelKernels();
@@ -0,0 +1,101 @@
+#include "threadpool.h"
+#include <atomic>
+#include <algorithm>
+
+struct ThreadPool::job_t
+{
+	const std::function<void(size_t)>& fn;
+	const size_t count;
+	std::atomic<size_t> next{ 0 };
+	std::atomic<size_t> done{ 0 };
+};
+
+ThreadPool& ThreadPool::Get()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+ThreadPool::ThreadPool()
+{
+	const unsigned int hardwareThreads = std::thread::hardware_concurrency();
+	const unsigned int workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+	workers.reserve(workerCount);
+	for (unsigned int i = 0; i < workerCount; ++i)
+		workers.emplace_back(&ThreadPool::WorkerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard lock(mutex);
+		stopping = true;
+	}
+	jobAdded.notify_all();
+	for (auto& worker : workers)
+		worker.join();
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& fn)
+{
+	if (count == 0)
+		return;
+
+	if (count == 1 || workers.empty())
+	{
+		for (size_t i = 0; i < count; ++i)
+			fn(i);
+		return;
+	}
+
+	auto job = std::make_shared<job_t>(fn, count);
+	{
+		std::lock_guard lock(mutex);
+		jobs.push_back(job);
+	}
+	jobAdded.notify_all();
+
+	Run(*job);
+
+	std::unique_lock lock(mutex);
+	jobFinished.wait(lock, [&job] { return job->done == job->count; });
+	if (auto it = std::find(jobs.begin(), jobs.end(), job); it != jobs.end())
+		jobs.erase(it);
+}
+
+void ThreadPool::Run(job_t& job)
+{
+	for (size_t i = job.next++; i < job.count; i = job.next++)
+	{
+		job.fn(i);
+		if (++job.done == job.count)
+		{
+			// Taking the lock makes sure the caller is either not checking yet or already waiting
+			std::lock_guard lock(mutex);
+			jobFinished.notify_all();
+		}
+	}
+}
+
+void ThreadPool::WorkerLoop()
+{
+	std::unique_lock lock(mutex);
+	while (true)
+	{
+		jobAdded.wait(lock, [this] { return stopping || !jobs.empty(); });
+		if (stopping)
+			return;
+
+		std::shared_ptr<job_t> job = jobs.front();
+		if (job->next >= job->count)
+		{
+			// Everything has been handed out, the remaining calls finish on their own
+			jobs.pop_front();
+			continue;
+		}
+
+		lock.unlock();
+		Run(*job);
+		lock.lock();
+	}
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Worker threads shared by the loaders, started on first use
+class ThreadPool
+{
+public:
+	static ThreadPool& Get();
+
+	// Calls fn(i) for every i in [0, count) on the workers and the calling thread and returns once
+	// all calls are done. Order of the calls is unspecified, so fn should only write to slot i.
+	// Safe to call from inside fn, the caller always works on its own job.
+	void ParallelFor(size_t count, const std::function<void(size_t)>& fn);
+
+	// Worker threads plus the calling thread
+	size_t GetThreadCount() const { return workers.size() + 1; }
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+	~ThreadPool();
+
+private:
+	struct job_t;
+
+	ThreadPool();
+	void WorkerLoop();
+	void Run(job_t& job);
+
+	std::vector<std::thread> workers;
+	std::deque<std::shared_ptr<job_t>> jobs;
+	std::mutex mutex;
+	std::condition_variable jobAdded;
+	std::condition_variable jobFinished;
+	bool stopping = false;
+};
@@ -0,0 +1,169 @@
+#include "vertexdecode.h"
+#include "dfxrecords.h"
+#include "cpufeatures.h"
+#include <cstddef>
+
+#if defined(CPU_X86)
+#include <immintrin.h>
+#endif
+
+// The SIMD kernels write whole vertices as two 16 byte halves, so they rely on this exact layout
+static_assert(sizeof(Model::vertex_t) == 32);
+static_assert(offsetof(Model::vertex_t, oX) == 12);
+static_assert(offsetof(Model::vertex_t, normalId) == 24);
+static_assert(offsetof(Model::vertex_t, r) == 26);
+static_assert(offsetof(Model::vertex_t, a) == 29);
+
+namespace
+{
+	void DecodeVerticesScalar(const unsigned char* src, size_t count, Model::vertex_t* dst, bool keepColors)
+	{
+		const cursor_t table{ src, count * DFX::VertexRecord::stride };
+		DFX::VertexRecord::ForEach(table, count, [dst, keepColors](size_t i, i16 x, i16 y, i16 z, u16 normalId, byte r, byte g, byte b, byte a)
+			{
+				if (!keepColors)
+				{
+					r = g = b = 128;
+					a = 255;
+				}
+				dst[i] = { x, z, (short)-y, x, z, (short)-y, normalId, r, g, b, a };
+			});
+	}
+
+	void DecodeSkyboxVerticesScalar(const unsigned char* src, size_t count, Model::vertex_t* dst)
+	{
+		const cursor_t table{ src, count * DFX::SkyboxVertexRecord::stride };
+		DFX::SkyboxVertexRecord::ForEach(table, count, [dst](size_t i, i16 vx, i16 vy, i16 vz, u16 normalId)
+			{
+				int x = vx * 20;
+				int y = vy * 20;
+				int z = vz * 20;
+				dst[i] = { x, z, -y, x, z, -y, normalId, 128, 128, 128, 255 };
+			});
+	}
+
+#if defined(CPU_X86)
+	// The 8 bytes after the position in the output are normalId, r, g, b, a and 2 bytes of padding,
+	// which is the source record's bytes 6-11 shifted into place
+	constexpr int c_GREY_LO = 0x8080'0000; // normalId kept, r = g = 128
+	constexpr int c_GREY_HI = 0x0000'FF80; // b = 128, a = 255
+
+	TARGET_SSE2 __m128i NegateY(__m128i v)
+	{
+		// Negated as a short like the scalar path, so -32768 stays -32768
+		const __m128i mask = _mm_set_epi16(0, 0, 0, 0, 0, 0, -1, 0);
+		const __m128i neg = _mm_sub_epi16(_mm_setzero_si128(), v);
+		return _mm_or_si128(_mm_andnot_si128(mask, v), _mm_and_si128(mask, neg));
+	}
+
+	TARGET_SSE2 void DecodeVerticesSSE2(const unsigned char* src, size_t count, Model::vertex_t* dst, bool keepColors)
+	{
+		const __m128i colorMask = keepColors ? _mm_set_epi32(0, 0, -1, -1) : _mm_set_epi32(0, 0, 0, 0xFFFF);
+		const __m128i colorBits = keepColors ? _mm_setzero_si128() : _mm_set_epi32(0, 0, c_GREY_HI, c_GREY_LO);
+
+		for (size_t i = 0; i < count; ++i, src += 12)
+		{
+			// x, y, z, normalId as shorts, y negated, then sign extended to ints
+			const __m128i pos16 = NegateY(_mm_loadl_epi64((const __m128i*)src));
+			const __m128i pos = _mm_srai_epi32(_mm_unpacklo_epi16(pos16, pos16), 16);
+
+			// Bytes 4-11 shifted down by 2 leaves normalId, r, g, b, a at the bottom
+			__m128i attribs = _mm_srli_epi64(_mm_loadl_epi64((const __m128i*)(src + 4)), 16);
+			attribs = _mm_or_si128(_mm_and_si128(attribs, colorMask), colorBits);
+
+			const __m128i lo = _mm_shuffle_epi32(pos, _MM_SHUFFLE(0, 1, 2, 0)); // x, z, -y, x
+			const __m128i hi = _mm_unpacklo_epi64(_mm_shuffle_epi32(pos, _MM_SHUFFLE(3, 3, 1, 2)), attribs); // z, -y, attribs
+
+			_mm_storeu_si128((__m128i*)&dst[i], lo);
+			_mm_storeu_si128((__m128i*)&dst[i] + 1, hi);
+		}
+	}
+
+	// Same as the SSE2 kernel with one vertex per 128 bit lane
+	TARGET_AVX2 void DecodeVerticesAVX2(const unsigned char* src, size_t count, Model::vertex_t* dst, bool keepColors)
+	{
+		const __m256i colorMask = keepColors ? _mm256_set_epi32(0, 0, -1, -1, 0, 0, -1, -1) : _mm256_set_epi32(0, 0, 0, 0xFFFF, 0, 0, 0, 0xFFFF);
+		const __m256i colorBits = keepColors ? _mm256_setzero_si256() : _mm256_set_epi32(0, 0, c_GREY_HI, c_GREY_LO, 0, 0, c_GREY_HI, c_GREY_LO);
+		const __m256i mask = _mm256_set_epi16(0, 0, 0, 0, 0, 0, -1, 0, 0, 0, 0, 0, 0, 0, -1, 0);
+
+		size_t i = 0;
+		for (; i + 2 <= count; i += 2, src += 24)
+		{
+			__m256i pos16 = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadl_epi64((const __m128i*)src)), _mm_loadl_epi64((const __m128i*)(src + 12)), 1);
+			const __m256i neg = _mm256_sub_epi16(_mm256_setzero_si256(), pos16);
+			pos16 = _mm256_or_si256(_mm256_andnot_si256(mask, pos16), _mm256_and_si256(mask, neg));
+			const __m256i pos = _mm256_srai_epi32(_mm256_unpacklo_epi16(pos16, pos16), 16);
+
+			__m256i attribs = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadl_epi64((const __m128i*)(src + 4))), _mm_loadl_epi64((const __m128i*)(src + 16)), 1);
+			attribs = _mm256_srli_epi64(attribs, 16);
+			attribs = _mm256_or_si256(_mm256_and_si256(attribs, colorMask), colorBits);
+
+			const __m256i lo = _mm256_shuffle_epi32(pos, _MM_SHUFFLE(0, 1, 2, 0));
+			const __m256i hi = _mm256_unpacklo_epi64(_mm256_shuffle_epi32(pos, _MM_SHUFFLE(3, 3, 1, 2)), attribs);
+
+			_mm256_storeu_si256((__m256i*)&dst[i], _mm256_permute2x128_si256(lo, hi, 0x20));
+			_mm256_storeu_si256((__m256i*)&dst[i + 1], _mm256_permute2x128_si256(lo, hi, 0x31));
+		}
+
+		if (i < count)
+			DecodeVerticesSSE2(src, count - i, dst + i, keepColors);
+	}
+
+	TARGET_SSE2 void DecodeSkyboxVerticesSSE2(const unsigned char* src, size_t count, Model::vertex_t* dst)
+	{
+		const __m128i negY = _mm_set_epi32(0, 0, -1, 0);
+		const __m128i grey = _mm_set_epi32(0, 0, c_GREY_HI, c_GREY_LO);
+
+		for (size_t i = 0; i < count; ++i, src += 8)
+		{
+			const __m128i raw = _mm_loadl_epi64((const __m128i*)src);
+			__m128i pos = _mm_srai_epi32(_mm_unpacklo_epi16(raw, raw), 16);
+			pos = _mm_add_epi32(_mm_slli_epi32(pos, 4), _mm_slli_epi32(pos, 2)); // * 20
+			pos = _mm_sub_epi32(_mm_xor_si128(pos, negY), negY);
+
+			const __m128i attribs = _mm_or_si128(_mm_srli_epi64(raw, 48), grey);
+
+			const __m128i lo = _mm_shuffle_epi32(pos, _MM_SHUFFLE(0, 1, 2, 0));
+			const __m128i hi = _mm_unpacklo_epi64(_mm_shuffle_epi32(pos, _MM_SHUFFLE(3, 3, 1, 2)), attribs);
+
+			_mm_storeu_si128((__m128i*)&dst[i], lo);
+			_mm_storeu_si128((__m128i*)&dst[i] + 1, hi);
+		}
+	}
+#endif
+
+	using decodevertices_t = void(*)(const unsigned char*, size_t, Model::vertex_t*, bool);
+	using decodeskybox_t = void(*)(const unsigned char*, size_t, Model::vertex_t*);
+
+	decodevertices_t SelectVertexKernel()
+	{
+#if defined(CPU_X86)
+		if (CPU::HasAVX2())
+			return DecodeVerticesAVX2;
+		if (CPU::HasSSE2())
+			return DecodeVerticesSSE2;
+#endif
+		return DecodeVerticesScalar;
+	}
+
+	decodeskybox_t SelectSkyboxKernel()
+	{
+#if defined(CPU_X86)
+		if (CPU::HasSSE2())
+			return DecodeSkyboxVerticesSSE2;
+#endif
+		return DecodeSkyboxVerticesScalar;
+	}
+}
+
+void DecodeVertices(const unsigned char* src, size_t count, Model::vertex_t* dst, bool keepColors)
+{
+	static const decodevertices_t kernel = SelectVertexKernel();
+	kernel(src, count, dst, keepColors);
+}
+
+void DecodeSkyboxVertices(const unsigned char* src, size_t count, Model::vertex_t* dst)
+{
+	static const decodeskybox_t kernel = SelectSkyboxKernel();
+	kernel(src, count, dst);
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include "mapreader.h"
+
+// Decodes count packed DFX vertices (DFX::VertexRecord) into dst in one pass: Y and Z are swapped,
+// the new Z is negated and the original position is duplicated into oX/oY/oZ.
+// Object vertices don't have usable colours, pass keepColors = false to write neutral grey instead.
+void DecodeVertices(const unsigned char* src, size_t count, Model::vertex_t* dst, bool keepColors);
+
+// Same for skybox vertices (DFX::SkyboxVertexRecord), which are scaled by 20 and always grey
+void DecodeSkyboxVertices(const unsigned char* src, size_t count, Model::vertex_t* dst);
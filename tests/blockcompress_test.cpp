@@ -0,0 +1,165 @@
+// Round-trips images through the BC1/BC3 encoder and checks the quality and the block layout
+#include "blockcompress.h"
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace
+{
+	int failures = 0;
+
+	void Expect(bool condition, const char* what)
+	{
+		if (!condition)
+		{
+			printf("FAIL %s\n", what);
+			++failures;
+		}
+	}
+
+	struct image_t
+	{
+		std::vector<rgba8_t> texels;
+		texture_t texture;
+
+		image_t(unsigned int w, unsigned int h) : texels((size_t)w * h), texture{ w, h, NULL, false }
+		{
+			texture.pixels = texels.data();
+		}
+
+		image_t(const image_t& other) : texels(other.texels), texture(other.texture)
+		{
+			texture.pixels = texels.data();
+		}
+
+		rgba8_t& At(unsigned int x, unsigned int y) { return texels[(size_t)y * texture.w + x]; }
+	};
+
+	image_t Gradient(unsigned int w, unsigned int h)
+	{
+		image_t image(w, h);
+		for (unsigned int y = 0; y < h; ++y)
+			for (unsigned int x = 0; x < w; ++x)
+				image.At(x, y) = { (unsigned char)(x * 255 / (w - 1)), (unsigned char)(y * 255 / (h - 1)), (unsigned char)((x + y) * 255 / (w + h - 2)), 255 };
+		return image;
+	}
+
+	// A gradient with holes punched in it, like the ARGB1555 cutouts
+	image_t Cutout(unsigned int w, unsigned int h)
+	{
+		image_t image = Gradient(w, h);
+		for (unsigned int y = 0; y < h; ++y)
+			for (unsigned int x = 0; x < w; ++x)
+				if ((x / 3 + y / 5) % 4 == 0)
+					image.At(x, y) = { 0, 0, 0, 0 };
+		return image;
+	}
+
+	image_t Translucent(unsigned int w, unsigned int h)
+	{
+		image_t image = Gradient(w, h);
+		for (unsigned int y = 0; y < h; ++y)
+			for (unsigned int x = 0; x < w; ++x)
+				image.At(x, y).a = (unsigned char)(x * 255 / (w - 1));
+		return image;
+	}
+
+	image_t Noise(unsigned int w, unsigned int h, unsigned int seed)
+	{
+		std::mt19937 rng(seed);
+		image_t image(w, h);
+		for (auto& texel : image.texels)
+			texel = { (unsigned char)rng(), (unsigned char)rng(), (unsigned char)rng(), 255 };
+		return image;
+	}
+
+	// Compresses, decompresses and checks the PSNR. Binary alpha has to come back exactly.
+	void RoundTrip(const char* name, const image_t& image, EBlockFormat format, double minPSNR, bool binaryAlpha)
+	{
+		const texture_t& source = image.texture;
+		std::vector<unsigned char> blocks(GetCompressedSize(format, source.w, source.h));
+		CompressImage(source, format, blocks.data());
+
+		image_t decoded(source.w, source.h);
+		DecompressImage(blocks.data(), format, decoded.texture);
+
+		const double psnr = ComputePSNR(source.pixels, decoded.texture.pixels, image.texels.size());
+		printf("%s %s: %.2f dB\n", name, format == EBlockFormat::BC1 ? "BC1" : "BC3", psnr);
+
+		char what[128];
+		snprintf(what, sizeof(what), "%s %s PSNR %.2f dB is below %.1f dB", name, format == EBlockFormat::BC1 ? "BC1" : "BC3", psnr, minPSNR);
+		Expect(psnr >= minPSNR, what);
+
+		if (binaryAlpha)
+		{
+			bool same = true;
+			for (size_t i = 0; i < image.texels.size(); ++i)
+				same &= image.texels[i].a == decoded.texels[i].a;
+			snprintf(what, sizeof(what), "%s %s changes the alpha", name, format == EBlockFormat::BC1 ? "BC1" : "BC3");
+			Expect(same, what);
+		}
+	}
+
+	// Encoding a rectangle has to give the same blocks as encoding the whole image, and leave the others alone
+	void RectMatchesWhole(EBlockFormat format)
+	{
+		const image_t image = Cutout(96, 64);
+		const sheetrect_t rect = { 20, 12, 52, 40 };
+
+		const size_t size = GetCompressedSize(format, 96, 64), blockSize = GetCompressedSize(format, 4, 4);
+		std::vector<unsigned char> updated(size, 0xEE), whole(size);
+		CompressRect(image.texture, format, rect, updated.data());
+		CompressImage(image.texture, format, whole.data());
+
+		bool same = true;
+		for (int by = 0; by < 64 / 4; ++by)
+		{
+			for (int bx = 0; bx < 96 / 4; ++bx)
+			{
+				const bool inside = bx * 4 >= rect.x0 && bx * 4 < rect.x1 && by * 4 >= rect.y0 && by * 4 < rect.y1;
+				const unsigned char* block = &updated[(by * (96 / 4) + bx) * blockSize];
+				if (inside)
+					same &= memcmp(block, &whole[(by * (96 / 4) + bx) * blockSize], blockSize) == 0;
+				else
+					same &= std::all_of(block, block + blockSize, [](unsigned char b) { return b == 0xEE; });
+			}
+		}
+		Expect(same, format == EBlockFormat::BC1 ? "BC1 rectangle doesn't match the whole image" : "BC3 rectangle doesn't match the whole image");
+	}
+}
+
+int main()
+{
+	Expect(ChooseBlockFormat(Gradient(64, 64).texture) == EBlockFormat::BC1, "opaque image doesn't pick BC1");
+	Expect(ChooseBlockFormat(Cutout(64, 64).texture) == EBlockFormat::BC1, "cutout image doesn't pick BC1");
+	const image_t translucent = Translucent(64, 64);
+	Expect(ChooseBlockFormat(translucent.texture) == EBlockFormat::BC3, "translucent image doesn't pick BC3");
+	Expect(ChooseBlockFormat(translucent.texture, { 0, 0, 1, 64 }) == EBlockFormat::BC1, "fully transparent column doesn't pick BC1");
+	Expect(ChooseBlockFormat(translucent.texture, { 4, 0, 8, 4 }) == EBlockFormat::BC3, "translucent rectangle doesn't pick BC3");
+
+	RoundTrip("gradient", Gradient(64, 64), EBlockFormat::BC1, 38.0, true);
+	RoundTrip("gradient", Gradient(64, 64), EBlockFormat::BC3, 38.0, true);
+	RoundTrip("cutout", Cutout(64, 64), EBlockFormat::BC1, 30.0, true);
+	RoundTrip("cutout", Cutout(64, 64), EBlockFormat::BC3, 30.0, true);
+	RoundTrip("translucent", Translucent(64, 64), EBlockFormat::BC3, 38.0, false);
+	RoundTrip("noise", Noise(128, 128, 7), EBlockFormat::BC1, 12.0, true);
+
+	// Flat colours that 565 holds exactly come back exactly
+	image_t flat(32, 32);
+	for (auto& texel : flat.texels)
+		texel = { 0x08, 0x10, 0xFF, 255 };
+	RoundTrip("flat", flat, EBlockFormat::BC1, 1000.0, true);
+
+	RectMatchesWhole(EBlockFormat::BC1);
+	RectMatchesWhole(EBlockFormat::BC3);
+
+	if (failures != 0)
+	{
+		printf("%d failures\n", failures);
+		return 1;
+	}
+	printf("All block compression checks passed\n");
+	return 0;
+}
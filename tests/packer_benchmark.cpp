@@ -0,0 +1,108 @@
+// Packs the sheet of every VFX given (or every VFX in the directories given) with each packer and
+// prints the sheet size, how much of it is used and how long the packing took.
+// Run from the viewer's folder so the custom images get packed too, like they are in the viewer.
+#include "mapreader.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace
+{
+	// Packing is quick, so every level is packed this many times and the time averaged
+	constexpr int c_REPEATS = 20;
+
+	struct strategy_t
+	{
+		ImagePacker::EStrategy strategy;
+		const char* name;
+		double totalMs = 0.0;
+		double totalUsed = 0.0;
+	};
+
+	void CollectFiles(const std::string& path, std::vector<std::string>& files)
+	{
+		std::error_code error;
+		if (!std::filesystem::is_directory(path, error))
+		{
+			files.push_back(path);
+			return;
+		}
+
+		std::vector<std::string> found;
+		for (auto& entry : std::filesystem::directory_iterator(path, error))
+		{
+			std::string extension = entry.path().extension().string();
+			for (auto& c : extension)
+				c = (char)tolower((unsigned char)c);
+			if (entry.is_regular_file() && extension == ".vfx")
+				found.push_back(entry.path().string());
+		}
+		std::sort(found.begin(), found.end());
+		files.insert(files.end(), found.begin(), found.end());
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		printf("Usage: %s <file.vfx or directory>...\n", argv[0]);
+		return 1;
+	}
+
+	std::vector<std::string> files;
+	for (int i = 1; i < argc; ++i)
+		CollectFiles(argv[i], files);
+
+	strategy_t strategies[] = {
+		{ ImagePacker::EStrategy::AtlasTree, "AtlasTree" },
+		{ ImagePacker::EStrategy::Skyline, "Skyline" }
+	};
+	const int padding = GetSheetPadding();
+	int packed = 0;
+
+	for (auto& file : files)
+	{
+		ImagePacker::ImageInformationList list;
+		if (!GetSheetImageList(file, list))
+		{
+			printf("%s: not a VFX, skipped\n", file.c_str());
+			continue;
+		}
+		printf("%s: %zu images\n", file.c_str(), list.size());
+
+		size_t area = 0;
+		for (auto& info : list)
+			area += (size_t)(info.width + 2 * padding) * (info.height + 2 * padding);
+
+		for (auto& strategy : strategies)
+		{
+			int size = 0;
+			const auto start = std::chrono::steady_clock::now();
+			for (int i = 0; i < c_REPEATS; ++i)
+			{
+				ImagePacker::ImageInformationList copy = list;
+				size = ImagePacker::GeneratePackedList(copy, 256, padding, strategy.strategy);
+			}
+			const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / c_REPEATS;
+
+			const double used = size != 0 ? 100.0 * area / ((size_t)size * size) : 0.0;
+			printf("  %-10s %5dx%-5d %5.1f%% used %9.3f ms\n", strategy.name, size, size, used, ms);
+			strategy.totalMs += ms;
+			strategy.totalUsed += used;
+		}
+		++packed;
+	}
+
+	if (packed == 0)
+		return 1;
+
+	printf("%d levels\n", packed);
+	for (auto& strategy : strategies)
+		printf("  %-10s %5.1f%% used on average %9.3f ms in total\n", strategy.name, strategy.totalUsed / packed, strategy.totalMs);
+	return 0;
+}
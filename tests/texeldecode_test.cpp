@@ -0,0 +1,113 @@
+// Checks every texel converter built for this CPU against the Glide formats, bit for bit
+#include "texeldecode.h"
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace
+{
+	// Straight from the format descriptions, independent of any of the kernels
+	rgba8_t ExpectedARGB4444(unsigned int p)
+	{
+		return { (unsigned char)(((p >> 8) & 0xF) * 0x11), (unsigned char)(((p >> 4) & 0xF) * 0x11), (unsigned char)((p & 0xF) * 0x11), (unsigned char)((p >> 12) * 0x11) };
+	}
+
+	rgba8_t ExpectedARGB1555(unsigned int p, bool cutout)
+	{
+		const bool opaque = (p & 0x8000) && !(cutout && (p & 0x7FFF) == 0);
+		return { (unsigned char)(((p >> 10) & 0x1F) << 3), (unsigned char)(((p >> 5) & 0x1F) << 3), (unsigned char)((p & 0x1F) << 3), (unsigned char)(opaque ? 0xFF : 0x00) };
+	}
+
+	// Texels past count must be left alone
+	constexpr size_t c_GUARD = 32;
+	constexpr rgba8_t c_GUARDTEXEL = { 0xAB, 0xCD, 0xEF, 0x12 };
+
+	int failures = 0;
+
+	// Runs the kernel over count texels read from src + offset bytes, so the loads aren't aligned either
+	void Check(const texelkernels_t& kernels, const char* format, decodetexels_t kernel, rgba8_t(*expected)(unsigned int, bool), bool cutout,
+		const std::vector<unsigned char>& texels, size_t offset, size_t count)
+	{
+		std::vector<unsigned char> src(offset + count * 2);
+		memcpy(src.data() + offset, texels.data(), count * 2);
+		std::vector<rgba8_t> dst(count + c_GUARD, c_GUARDTEXEL);
+		kernel(src.data() + offset, count, dst.data());
+
+		for (size_t i = 0; i < count + c_GUARD; ++i)
+		{
+			const unsigned int p = i < count ? texels[i * 2] | (texels[i * 2 + 1] << 8) : 0;
+			const rgba8_t want = i < count ? expected(p, cutout) : c_GUARDTEXEL;
+			if (memcmp(&dst[i], &want, sizeof(rgba8_t)) != 0)
+			{
+				printf("FAIL %s %s: count %zu offset %zu, texel %zu (%04x) is %02x%02x%02x%02x, expected %02x%02x%02x%02x\n",
+					kernels.name, format, count, offset, i, p, dst[i].r, dst[i].g, dst[i].b, dst[i].a, want.r, want.g, want.b, want.a);
+				++failures;
+				return;
+			}
+		}
+	}
+
+	void CheckAll(const texelkernels_t& kernels, const std::vector<unsigned char>& texels, size_t offset, size_t count)
+	{
+		Check(kernels, "ARGB4444", kernels.argb4444, [](unsigned int p, bool) { return ExpectedARGB4444(p); }, false, texels, offset, count);
+		Check(kernels, "ARGB1555", kernels.argb1555, ExpectedARGB1555, false, texels, offset, count);
+		Check(kernels, "ARGB1555 cutout", kernels.argb1555Cutout, ExpectedARGB1555, true, texels, offset, count);
+	}
+}
+
+int main()
+{
+	// Every 16 bit value once
+	std::vector<unsigned char> every(0x10000 * 2);
+	for (size_t i = 0; i < 0x10000; ++i)
+	{
+		every[i * 2 + 0] = (unsigned char)(i & 0xFF);
+		every[i * 2 + 1] = (unsigned char)(i >> 8);
+	}
+
+	// The values the cutout and the nibble/5 bit splits hinge on, repeated so every lane sees them
+	const unsigned int edges[] = { 0x0000, 0x8000, 0x7FFF, 0xFFFF, 0x8001, 0x0001, 0xF000, 0x0FFF, 0x83E0, 0xFC00, 0x801F };
+	std::vector<unsigned char> edge;
+	for (int i = 0; i < 128; ++i)
+	{
+		const unsigned int p = edges[i % (sizeof(edges) / sizeof(edges[0]))];
+		edge.push_back((unsigned char)(p & 0xFF));
+		edge.push_back((unsigned char)(p >> 8));
+	}
+
+	std::mt19937 rng(1234);
+	std::vector<unsigned char> random(4096 * 2);
+	for (auto& b : random)
+		b = (unsigned char)rng();
+
+	int tested = 0;
+	for (const auto& kernels : GetTexelKernels())
+	{
+		if (!kernels.supported)
+		{
+			printf("%s: not supported by this CPU, skipped\n", kernels.name);
+			continue;
+		}
+
+		CheckAll(kernels, every, 0, 0x10000);
+		// Every count up to a few vectors of the widest kernel, including all the leftovers it
+		// hands down to the narrower ones
+		for (size_t count = 0; count <= 67; ++count)
+		{
+			CheckAll(kernels, edge, 0, count);
+			CheckAll(kernels, random, count % 3, count);
+		}
+		CheckAll(kernels, random, 1, 4096);
+		printf("%s: done\n", kernels.name);
+		++tested;
+	}
+
+	if (failures != 0)
+	{
+		printf("%d failures\n", failures);
+		return 1;
+	}
+	printf("All %d texel kernels match\n", tested);
+	return 0;
+}